@@ -1,6 +1,9 @@
 #pragma once
 #include "pch.h"
 #include "Animation.h"
+#include "AnimationBinary.h"
+#include "Qoi.h"
+#include "TextIO.h"
 
 /*
     AnimationSheet text file format:
@@ -17,147 +20,313 @@
                 > duration
 */
 
-void AnimationSheet::save_to_text_file(const char* path) const {
-    SDL_RWops* file_ptr = SDL_RWFromFile(path, "w");
-    SDL_assert_always(file_ptr);
-
-    const size_t TEXT_BUF_SIZE = 1024;
-    char text_buf[TEXT_BUF_SIZE];
-
-    int length =
-        sprintf_s(text_buf, TEXT_BUF_SIZE,
-                  "# Sprite sheet path\n%s\n# Dimensions\n%d,%d\n# Number of "
-                  "animations\n%zu\n",
-                  png_file_name, sprite_dimensions.x, sprite_dimensions.y,
-                  animations.size());
-    SDL_assert(length != -1);
-    SDL_RWwrite(file_ptr, text_buf, sizeof(char), length);
+void AnimationSheetSnapshot::write_text(TextWriter& writer) const {
+    // Rough estimate so the buffer doesn't need to grow for most files
+    size_t num_steps = 0;
+    for (const auto& anim : animations) {
+        num_steps += anim.steps.size();
+    }
+    writer.reserve(256 + animations.size() * 128 + num_steps * 16);
+
+    writer.write("# Sprite sheet path\n");
+    writer.write(png_file_name);
+    writer.write("\n# Dimensions\n");
+    writer.write_int(sprite_dimensions.x);
+    writer.write_char(',');
+    writer.write_int(sprite_dimensions.y);
+    writer.write("\n# Number of animations\n");
+    writer.write_size(animations.size());
+    writer.write_char('\n');
 
     for (const auto& anim : animations) {
-        length = sprintf_s(text_buf, "# Animation\n%s\n%zu\n# Steps\n",
-                           anim.name, anim.steps.size());
-        SDL_assert(length != -1);
-        SDL_RWwrite(file_ptr, text_buf, sizeof(char), length);
+        writer.write("# Animation\n");
+        writer.write(anim.name);
+        writer.write_char('\n');
+        writer.write_size(anim.steps.size());
+        writer.write("\n# Steps\n");
 
         for (const auto& step : anim.steps) {
-            length = sprintf_s(text_buf, "%d\n%f\n", step.sprite_index,
-                               step.duration);
-            SDL_assert(length != -1);
-            SDL_RWwrite(file_ptr, text_buf, sizeof(char), length);
+            writer.write_int(step.sprite_index);
+            writer.write_char('\n');
+            writer.write_float(step.duration);
+            writer.write_char('\n');
         }
     }
+}
 
-    SDL_RWclose(file_ptr);
+AnimationSheet::AnimationSheet() {}
+
+AnimationSheet::~AnimationSheet() {
+    if (png_file_name) {
+        delete[] png_file_name;
+    }
+}
+
+AnimationSheetSnapshot AnimationSheet::snapshot() const {
+    AnimationSheetSnapshot result;
+    result.png_file_name = png_file_name ? png_file_name : "";
+    result.sprite_dimensions = sprite_dimensions;
+    result.animations = animations;
+
+    for (const auto& anim : result.animations) {
+        SDL_assert(anim.steps_loaded);
+    }
+    return result;
 }
 
-void AnimationSheet::load_from_text_file(const char* path) {
+bool AnimationSheet::save_to_text_file(const char* path) const {
+    TextWriter writer;
+    snapshot().write_text(writer);
+
+    SDL_RWops* file_ptr = SDL_RWFromFile(path, "w");
+    if (!file_ptr) {
+        return false;
+    }
+
+    size_t written =
+        SDL_RWwrite(file_ptr, writer.data(), sizeof(char), writer.size());
+    // Closing flushes, that can fail too
+    bool success = SDL_RWclose(file_ptr) == 0 && written == writer.size();
+    if (!success) {
+        SDL_SetError("Can't write %s", path);
+    }
+    return success;
+}
+
+bool AnimationSheet::load_from_text_file(const char* path) {
     SDL_RWops* file_ptr = SDL_RWFromFile(path, "r");
-    SDL_assert_always(file_ptr);
+    if (!file_ptr) {
+        return false;
+    }
 
     glm::i64 file_size = SDL_RWsize(file_ptr);
-    // Keep this pointer to the start of the buffer so it can be deleted later
-    char* file_buf = new char[file_size];
-    char* next_char = file_buf;
-
-    SDL_RWread(file_ptr, next_char, sizeof(char), file_size);
-
-    const size_t WORD_BUF_SIZE = MAX_SPRITE_PATH_LENGTH;
-    char word_buf[WORD_BUF_SIZE];
-
-    // Reads characters from next_char into word_buf (while moving next_char)
-    // until delim is found or end of file is reached. Returns number of
-    // characters written (including deliminating \0 character).
-    auto read_word = [&next_char, WORD_BUF_SIZE](char* dst_buf,
-                                                 char delim = '\n') -> size_t {
-        while (*next_char == '#') {
-            // Comment, skip line
-            while (*next_char != '\n') {
-                if (*next_char == '\0') {
-                    // This should never happen if we read files that were
-                    // written by this application
-                    SDL_TriggerBreakpoint();
-                    return 0;
-                }
-                ++next_char;
-            }
+    if (file_size < 0) {
+        SDL_RWclose(file_ptr);
+        return false;
+    }
+
+    std::vector<char> file_buf(static_cast<size_t>(file_size));
+    size_t bytes_read = SDL_RWread(file_ptr, file_buf.data(), sizeof(char),
+                                   file_buf.size());
+    SDL_RWclose(file_ptr);
+
+    file_buf.resize(bytes_read);
+    return load_from_text(std::move(file_buf), path);
+}
+
+bool AnimationSheet::load_from_text(std::vector<char>&& file_buf,
+                                    const char* path) {
+
+    // Everything is parsed into locals first, so a malformed file leaves this
+    // sheet untouched. Only the table of contents is read, the step lines are
+    // skipped without parsing them. They are parsed and checked once they
+    // are loaded in load_steps().
+    TextReader reader(file_buf.data(), file_buf.size());
+
+    // Read png file name
+    std::string_view png_name;
+    if (!reader.next_line(png_name) ||
+        png_name.size() >= MAX_SPRITE_PATH_LENGTH) {
+        return false;
+    }
+
+    // Read sprite dimensions
+    glm::ivec2 new_sprite_dimensions;
+    if (!reader.read_int_pair(new_sprite_dimensions)) {
+        return false;
+    }
+
+    // Read animations
+    size_t num_animations;
+    if (!reader.read_size(num_animations)) {
+        return false;
+    }
+
+    std::vector<Animation> new_animations;
+    // Every animation takes up at least two lines, so this can't be used to
+    // make us allocate huge amounts of memory
+    new_animations.reserve(std::min(num_animations, reader.bytes_left() / 2));
+
+    for (size_t n_animation = 0; n_animation < num_animations; ++n_animation) {
+        Animation& anim = new_animations.emplace_back();
+
+        std::string_view name;
+        if (!reader.next_line(name)) {
+            return false;
         }
-        if (*next_char == '\r' || *next_char == '\n') {
-            ++next_char;
+        size_t name_length =
+            std::min(name.size(), Animation::MAX_NAME_LENGTH - 1);
+        memcpy(anim.name, name.data(), name_length);
+        anim.name[name_length] = '\0';
+
+        if (!reader.read_size(anim.toc.num_steps)) {
+            return false;
         }
+        anim.toc.offset = reader.offset();
+        anim.steps_loaded = false;
 
-        size_t num_chars_written = 0;
-        while (*next_char != delim && num_chars_written != WORD_BUF_SIZE - 1) {
-            if (*next_char == '\r') {
-                // To deal with different end of line sequences
-                ++next_char;
-                continue;
-            }
-            *dst_buf++ = *next_char++;
-            ++num_chars_written;
+        // Two lines per step, so this can't loop much longer than the file
+        if (anim.toc.num_steps > reader.bytes_left()) {
+            return false;
         }
-        // Add deliminating null character and advance next_char pointer
-        SDL_assert_always(num_chars_written < WORD_BUF_SIZE);
-        *dst_buf = '\0';
-        ++next_char;
-        return ++num_chars_written;
-    };
+        if (!reader.skip_lines(2 * anim.toc.num_steps)) {
+            return false;
+        }
+    }
 
-    // Read png file name
-    size_t png_name_length = read_word(word_buf);
     if (png_file_name) {
         delete[] png_file_name;
     }
-    png_file_name = new char[png_name_length];
-    strcpy_s(png_file_name, png_name_length, word_buf);
+    png_file_name = new char[png_name.size() + 1];
+    memcpy(png_file_name, png_name.data(), png_name.size());
+    png_file_name[png_name.size()] = '\0';
 
-    // Create full path to png from path and png_file_name
-    std::string png_path(path);
-    size_t last_slash = png_path.find_last_of('\\');
-    png_path.erase(last_slash);
-    png_path.append(png_file_name);
+    locate_sprite_sheet(path);
 
-    sprite_sheet.load_from_file(png_path.c_str());
+    sprite_dimensions = new_sprite_dimensions;
+    update_num_sprites();
 
-    // Read sprite dimensions
-    read_word(word_buf, ',');
-    sprite_dimensions.x = atoi(word_buf);
-    read_word(word_buf);
-    sprite_dimensions.y = atoi(word_buf);
+    animations = std::move(new_animations);
+    text_source = std::move(file_buf);
+    binary_source.reset();
 
-    num_sprites = (sprite_sheet.dimensions.x / sprite_dimensions.x) *
-                  (sprite_sheet.dimensions.y / sprite_dimensions.y);
+    return true;
+}
 
-    // Read animations
-    read_word(word_buf);
-    size_t num_animations = atoi(word_buf);
+bool AnimationSheet::read_steps(
+    const Animation::TocEntry& toc,
+    std::vector<Animation::AnimationStepData>& steps) const {
+    steps.clear();
 
-    animations.clear();
-    animations.reserve(num_animations);
+    if (binary_source) {
+        const auto* first = binary_source->animation_steps(toc.offset);
+        steps.assign(first, first + toc.num_steps);
+        return true;
+    }
 
-    for (size_t n_animation = 0; n_animation < num_animations; ++n_animation) {
-        Animation anim;
-        read_word(word_buf);
-        strncpy_s(anim.name, word_buf, Animation::MAX_NAME_LENGTH);
-
-        read_word(word_buf);
-        size_t num_steps = atoi(word_buf);
-        anim.steps.reserve(num_steps);
-
-        for (size_t n_step = 0; n_step < num_steps; ++n_step) {
-            Animation::AnimationStepData step;
-
-            read_word(word_buf);
-            step.sprite_index = atoi(word_buf);
-            read_word(word_buf);
-            step.duration = static_cast<float>(atof(word_buf));
-            anim.steps.push_back(step);
+    SDL_assert(toc.offset <= text_source.size());
+    TextReader reader(text_source.data() + toc.offset,
+                      text_source.size() - toc.offset);
+
+    steps.reserve(toc.num_steps);
+    for (size_t n_step = 0; n_step < toc.num_steps; ++n_step) {
+        Animation::AnimationStepData step;
+        if (!reader.read_int(step.sprite_index) ||
+            !reader.read_float(step.duration)) {
+            return false;
         }
-        animations.push_back(anim);
+        steps.push_back(step);
     }
+    return true;
+}
 
-    delete[] file_buf;
+bool AnimationSheet::load_steps(Animation& anim) {
+    if (anim.steps_loaded) {
+        return true;
+    }
+    // Steps that were read only partly are never shown or saved
+    anim.steps_loaded = read_steps(anim.toc, anim.steps);
+    if (!anim.steps_loaded) {
+        anim.steps.clear();
+    }
+    anim.update_timeline();
+    return anim.steps_loaded;
+}
+
+bool AnimationSheet::load_all_steps() {
+    for (auto& anim : animations) {
+        if (!load_steps(anim)) {
+            return false;
+        }
+    }
+
+    text_source.clear();
+    text_source.shrink_to_fit();
+    binary_source.reset();
+    return true;
+}
 
+// Reads the dimensions from the header of a png or qoi file without decoding
+// it
+static bool read_image_dimensions(const char* path, glm::ivec2& dimensions) {
+    SDL_RWops* file_ptr = SDL_RWFromFile(path, "rb");
+    if (!file_ptr) {
+        return false;
+    }
+
+    // Signature, then the IHDR chunk with big endian width and height
+    const size_t PNG_HEADER_SIZE = 24;
+    const glm::u8 SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    glm::u8 header[PNG_HEADER_SIZE];
+
+    size_t bytes_read = SDL_RWread(file_ptr, header, 1, PNG_HEADER_SIZE);
     SDL_RWclose(file_ptr);
+
+    Qoi::Header qoi_header;
+    if (Qoi::read_header(header, bytes_read, qoi_header)) {
+        dimensions.x = static_cast<int>(qoi_header.width);
+        dimensions.y = static_cast<int>(qoi_header.height);
+        return true;
+    }
+
+    if (bytes_read != PNG_HEADER_SIZE || memcmp(header, SIGNATURE, 8) != 0 ||
+        memcmp(header + 12, "IHDR", 4) != 0) {
+        return false;
+    }
+
+    dimensions.x = (header[16] << 24) | (header[17] << 16) |
+                   (header[18] << 8) | header[19];
+    dimensions.y = (header[20] << 24) | (header[21] << 16) |
+                   (header[22] << 8) | header[23];
+    return true;
+}
+
+void AnimationSheet::locate_sprite_sheet(const char* anim_path) {
+    // Create full path to png from anim_path and png_file_name
+    png_path = anim_path;
+    size_t last_slash = png_path.find_last_of("\\/");
+    if (last_slash == std::string::npos) {
+        png_path.clear();
+    } else {
+        png_path.erase(last_slash);
+    }
+    png_path.append(png_file_name);
+
+    // Dimensions of 0 tell the caller that the image couldn't be read
+    if (!read_image_dimensions(png_path.c_str(), sprite_sheet.dimensions)) {
+        sprite_sheet.dimensions = {0, 0};
+    }
+}
+
+void replace_extension(std::string& path, const char* extension) {
+    size_t dot = path.find_last_of('.');
+    size_t last_slash = path.find_last_of("\\/");
+    if (dot != std::string::npos &&
+        (last_slash == std::string::npos || dot > last_slash)) {
+        path.erase(dot);
+    }
+    path.append(extension);
+}
+
+void AnimationSheet::replace_sprite_sheet_extension(const char* extension) {
+    std::string file_name = png_file_name ? png_file_name : "";
+    replace_extension(file_name, extension);
+    replace_extension(png_path, extension);
+
+    if (png_file_name) {
+        delete[] png_file_name;
+    }
+    png_file_name = new char[file_name.size() + 1];
+    memcpy(png_file_name, file_name.c_str(), file_name.size() + 1);
+}
+
+void AnimationSheet::update_num_sprites() {
+    if (sprite_dimensions.x <= 0 || sprite_dimensions.y <= 0) {
+        num_sprites = 0;
+        return;
+    }
+    num_sprites = (sprite_sheet.dimensions.x / sprite_dimensions.x) *
+                  (sprite_sheet.dimensions.y / sprite_dimensions.y);
 }
 
 template <typename T> static T greatest_common_divisor(T a, T b) {
@@ -176,45 +345,96 @@ void AnimationSheet::create_new_from_png(const char* path) {
     png_file_name = new char[length];
     strcpy_s(png_file_name, length, sprite_name);
 
-    sprite_sheet.load_from_file(path);
+    png_path = path;
+    if (!read_image_dimensions(path, sprite_sheet.dimensions)) {
+        printf("ERROR: Can't read sprite sheet %s\n", path);
+        sprite_sheet.dimensions = {0, 0};
+    }
 
     // Make a reasonable guess at the new sprite sheets sprite dimensions
     sprite_dimensions = glm::ivec2(greatest_common_divisor(
         sprite_sheet.dimensions.x, sprite_sheet.dimensions.y));
 
-    num_sprites = (sprite_sheet.dimensions.x / sprite_dimensions.x) *
-                  (sprite_sheet.dimensions.y / sprite_dimensions.y);
+    update_num_sprites();
 
     animations.clear();
+    text_source.clear();
+    binary_source.reset();
+}
+
+void Animation::update_timeline() {
+    step_end_times.resize(steps.size());
+
+    // Every duration is rounded on its own, so where a step starts doesn't
+    // depend on the steps before it
+    glm::u64 time = 0;
+    for (size_t i = 0; i < steps.size(); ++i) {
+        time = std::min<glm::u64>(time + frames_to_ticks(steps[i].duration),
+                                  MAX_TICKS);
+        step_end_times[i] = static_cast<Ticks>(time);
+    }
+}
+
+Ticks Animation::get_total_duration() const {
+    return step_end_times.empty() ? 0 : step_end_times.back();
+}
+
+size_t Animation::find_step(Ticks time) const {
+    SDL_assert(!step_end_times.empty());
+
+    // First step that ends after time. Steps with a duration of 0 are never
+    // shown.
+    auto it = std::upper_bound(step_end_times.begin(), step_end_times.end(),
+                               time);
+    if (it == step_end_times.end()) {
+        // Only happens if time is past the end
+        return step_end_times.size() - 1;
+    }
+    return it - step_end_times.begin();
 }
 
 void AnimationPreview::set_animation(const Animation* anim) {
     animation = anim;
     current_step = 0;
-    current_duration = 0.0f;
+    current_time = 0;
 }
 
-void AnimationPreview::update(float delta_time) {
+void AnimationPreview::update(Ticks delta_time) {
+    SDL_assert(delta_time <= MAX_TICKS);
+    // Can't overflow, current_time is below MAX_TICKS as well
+    seek(current_time + delta_time);
+}
+
+void AnimationPreview::seek(Ticks time) {
     if (animation == nullptr || animation->steps.size() == 0) {
         return;
     }
+    SDL_assert(animation->step_end_times.size() == animation->steps.size());
 
-    if (current_step >= animation->steps.size()) {
+    Ticks total_duration = animation->get_total_duration();
+    if (total_duration == 0) {
         current_step = 0;
-        current_duration = 0.0f;
+        current_time = 0;
+        return;
     }
 
-    current_duration += delta_time;
-    float sprite_duration = animation->steps[current_step].duration;
+    time %= total_duration;
+    current_time = time;
 
-    if (current_duration > sprite_duration) {
-        current_duration -= sprite_duration;
-        ++current_step;
+    // Usually we are still in the same step
+    const auto& end_times = animation->step_end_times;
+    if (current_step < end_times.size() && time < end_times[current_step] &&
+        (current_step == 0 || time >= end_times[current_step - 1])) {
+        return;
+    }
+    current_step = animation->find_step(time);
+}
 
-        if (current_step == animation->steps.size()) {
-            current_step = 0;
-        }
+Ticks AnimationPreview::get_ticks_to_next_step() const {
+    if (animation == nullptr || animation->get_total_duration() == 0) {
+        return 0;
     }
+    return animation->step_end_times[current_step] - current_time;
 }
 
 int AnimationPreview::get_sprite_index() {
@@ -1,6 +1,7 @@
 #pragma once
 #include "pch.h"
 #include "Texture.h"
+#include "PlaybackClock.h"
 
 struct Animation {
     static const size_t MAX_NAME_LENGTH = 64;
@@ -13,30 +14,137 @@ struct Animation {
     };
 
     std::vector<AnimationStepData> steps;
+
+    // step_end_times[i] is the tick at which step i ends, counted from the
+    // start of the animation. Has to be rebuilt with update_timeline()
+    // whenever the steps change.
+    std::vector<Ticks> step_end_times;
+
+    void update_timeline();
+    Ticks get_total_duration() const;
+    // Returns the step that is shown at time, which has to be in
+    // [0, get_total_duration())
+    size_t find_step(Ticks time) const;
+
+    // Animations are opened with only their table of contents entry, the
+    // steps are read from the file once they are needed (see
+    // AnimationSheet::load_steps()).
+    struct TocEntry {
+        size_t num_steps = 0;
+        // Byte offset of the first step in a .anim file, index of the
+        // animation in a .animb file
+        size_t offset = 0;
+    };
+    TocEntry toc;
+    bool steps_loaded = true;
+};
+
+// Replaces everything after the last dot of the file name, or appends the
+// extension if there is none
+void replace_extension(std::string& path, const char* extension);
+
+class TextWriter;
+class MappedAnimationSheet;
+
+// Copy of everything that is written to an animation file. It owns no GL
+// resources, so it can be handed to another thread while the sheet itself
+// keeps being edited.
+struct AnimationSheetSnapshot {
+    std::string png_file_name;
+    glm::ivec2 sprite_dimensions;
+    std::vector<Animation> animations;
+
+    // Serialize the whole file into memory. The text format is described in
+    // Animation.cpp, the binary format in AnimationBinary.h.
+    void write_text(TextWriter& writer) const;
+    void write_binary(std::vector<char>& file_buf) const;
 };
 
 struct AnimationSheet {
-    char* png_file_name;
+    char* png_file_name = nullptr;
+    // Full path of the sprite sheet, a png or qoi file
+    std::string png_path;
+    // Loading a sheet only reads the dimensions of the image, so the sheet
+    // can be used without a GL context. The texture is loaded with
+    // sprite_sheet.load_from_file(png_path).
     Texture sprite_sheet;
     glm::ivec2 sprite_dimensions;
     size_t num_sprites;
 
     std::vector<Animation> animations;
 
-    void save_to_text_file(const char* path) const;
-    void load_from_text_file(const char* path);
+    // The opened file is kept around until the steps of every animation have
+    // been read from it. Only one of these is in use at a time.
+    std::vector<char> text_source;
+    std::unique_ptr<MappedAnimationSheet> binary_source;
+
+    AnimationSheet();
+    ~AnimationSheet();
+
+    AnimationSheet(const AnimationSheet&) = delete;
+    AnimationSheet& operator=(const AnimationSheet&) = delete;
+
+    // Writes the file synchronously, the editor saves through AsyncSaver
+    // instead. Every animation has to be loaded. Returns false and sets the
+    // SDL error if the file can't be written.
+    bool save_to_text_file(const char* path) const;
+    // Returns false if the file is malformed, the sheet is left unchanged in
+    // that case.
+    bool load_from_text_file(const char* path);
+    // Starts a sheet without animations for a png or qoi image
     void create_new_from_png(const char* path);
 
+    // See AnimationBinary.h for the format. Saving works like
+    // save_to_text_file(), loading returns false if the file is not a valid
+    // .animb file.
+    bool save_to_binary_file(const char* path) const;
+    bool load_from_binary_file(const char* path);
+
+    // Parses an .anim file that was already read into memory. path is only
+    // used to find the sprite sheet.
+    bool load_from_text(std::vector<char>&& file_buf, const char* path);
+
+    // Sets png_path from png_file_name, which is relative to the directory of
+    // the animation file at anim_path.
+    void locate_sprite_sheet(const char* anim_path);
+    // Points the sheet at the file next to the sprite sheet with the same
+    // name and another extension, e.g. ".qoi" after converting the image
+    void replace_sprite_sheet_extension(const char* extension);
+    void update_num_sprites();
+
+    // Reads the steps of an animation that was opened lazily. Does nothing if
+    // they are already loaded. Returns false if the steps are malformed, the
+    // animation is left without steps and not marked as loaded then.
+    bool load_steps(Animation& anim);
+    // Reads all remaining steps and closes the opened file. Returns false if
+    // any steps are malformed, the file stays open then and the sheet must
+    // not be saved.
+    bool load_all_steps();
+
+    // Every animation has to be loaded, see load_all_steps()
+    AnimationSheetSnapshot snapshot() const;
+
     static const size_t MAX_SPRITE_PATH_LENGTH = 256;
+
+  private:
+    bool read_steps(const Animation::TocEntry& toc,
+                    std::vector<Animation::AnimationStepData>& steps) const;
 };
 
 class AnimationPreview {
-    const Animation* animation;
-    size_t current_step;
-    float current_duration;
+    const Animation* animation = nullptr;
+    size_t current_step = 0;
+    // Time since the animation last started over
+    Ticks current_time = 0;
 
   public:
     void set_animation(const Animation* anim);
-    void update(float delta_time);
+    // delta_time can't be more than MAX_TICKS
+    void update(Ticks delta_time);
+    // Jumps to any time in the animation, times past the end wrap around
+    void seek(Ticks time);
+    Ticks get_time() const { return current_time; }
+    // Ticks until the next step starts, or 0 if the sprite never changes
+    Ticks get_ticks_to_next_step() const;
     glm::i32 get_sprite_index();
 };
\ No newline at end of file
@@ -0,0 +1,173 @@
+#pragma once
+#include "pch.h"
+#include "AnimationBatch.h"
+#include "ThreadPool.h"
+
+void AnimationBatch::set_animations(const std::vector<Animation>& animations) {
+    anim_first_step.clear();
+    anim_total_duration.clear();
+    step_end_times.clear();
+    step_sprite_indices.clear();
+
+    for (const auto& anim : animations) {
+        SDL_assert(anim.steps_loaded &&
+                   anim.step_end_times.size() == anim.steps.size());
+        anim_first_step.push_back(static_cast<glm::u32>(step_end_times.size()));
+
+        step_end_times.insert(step_end_times.end(), anim.step_end_times.begin(),
+                              anim.step_end_times.end());
+        for (const auto& step : anim.steps) {
+            step_sprite_indices.push_back(step.sprite_index);
+        }
+
+        // Animations without steps get one that is never left, with the same
+        // sprite index AnimationPreview returns for them
+        if (anim.steps.empty()) {
+            step_end_times.push_back(0);
+            step_sprite_indices.push_back(-1);
+        }
+        anim_total_duration.push_back(anim.get_total_duration());
+    }
+    anim_first_step.push_back(static_cast<glm::u32>(step_end_times.size()));
+
+    for (size_t i = 0; i < num_instances(); ++i) {
+        glm::u32 anim = instance_anim[i];
+        SDL_assert(anim < animations.size());
+
+        instance_step[i] = anim_first_step[anim];
+        instance_time[i] = 0;
+        instance_total_duration[i] = anim_total_duration[anim];
+    }
+    resolve_steps(0, num_instances());
+}
+
+size_t AnimationBatch::add_instance(size_t anim_index, Ticks start_time) {
+    SDL_assert(anim_index + 1 < anim_first_step.size());
+
+    Ticks total_duration = anim_total_duration[anim_index];
+    start_time = total_duration > 0 ? start_time % total_duration : 0;
+
+    // Same search as Animation::find_step()
+    auto first = step_end_times.begin() + anim_first_step[anim_index];
+    auto last = step_end_times.begin() + anim_first_step[anim_index + 1] - 1;
+    auto step = std::min(std::upper_bound(first, last, start_time), last);
+
+    instance_anim.push_back(static_cast<glm::u32>(anim_index));
+    instance_step.push_back(
+        static_cast<glm::u32>(step - step_end_times.begin()));
+    instance_time.push_back(start_time);
+    instance_total_duration.push_back(total_duration);
+    sprite_indices.push_back(step_sprite_indices[instance_step.back()]);
+
+    return num_instances() - 1;
+}
+
+void AnimationBatch::clear_instances() {
+    instance_anim.clear();
+    instance_step.clear();
+    instance_time.clear();
+    instance_total_duration.clear();
+    sprite_indices.clear();
+}
+
+void AnimationBatch::seek(size_t instance, Ticks time) {
+    SDL_assert(instance < num_instances());
+
+    Ticks total_duration = instance_total_duration[instance];
+    instance_time[instance] = total_duration > 0 ? time % total_duration : 0;
+    // Finds the step from the start of the animation if time went back
+    resolve_steps(instance, instance + 1);
+}
+
+void AnimationBatch::update(Ticks delta_time) {
+    advance_time(delta_time, 0, num_instances());
+    resolve_steps(0, num_instances());
+}
+
+void AnimationBatch::update_parallel(Ticks delta_time, ThreadPool& pool) {
+    // Big enough that a chunk takes much longer than taking it from a queue,
+    // and a multiple of the SIMD width so chunks don't split vectors
+    const size_t CHUNK_SIZE = 16384;
+
+    pool.parallel_for(num_instances(), CHUNK_SIZE,
+                      [this, delta_time](size_t begin, size_t end) {
+                          advance_time(delta_time, begin, end);
+                          resolve_steps(begin, end);
+                      });
+}
+
+Ticks AnimationBatch::get_ticks_to_next_step() const {
+    Ticks result = 0;
+    for (size_t i = 0; i < num_instances(); ++i) {
+        if (instance_total_duration[i] == 0) {
+            continue;
+        }
+        Ticks ticks = step_end_times[instance_step[i]] - instance_time[i];
+        if (result == 0 || ticks < result) {
+            result = ticks;
+        }
+    }
+    return result;
+}
+
+void AnimationBatch::advance_time(Ticks delta_time, size_t begin,
+                                  size_t end) {
+    SDL_assert(delta_time <= MAX_TICKS);
+
+    Ticks* times = instance_time.data();
+    const Ticks* total_durations = instance_total_duration.data();
+
+    // No branches or lookups, this loop gets vectorized. Both the times and
+    // delta_time are at most MAX_TICKS, so the sum can't overflow.
+    // Subtracting once is enough as long as delta_time is shorter than the
+    // animation.
+    for (size_t i = begin; i < end; ++i) {
+        Ticks time = times[i] + delta_time;
+        Ticks total_duration = total_durations[i];
+        times[i] = time >= total_duration ? time - total_duration : time;
+    }
+
+    // Catches up with the rest, which happens for long deltas and animations
+    // without any duration. Gives the same result as AnimationPreview::seek().
+    for (size_t i = begin; i < end; ++i) {
+        if (times[i] >= total_durations[i]) {
+            Ticks total_duration = total_durations[i];
+            times[i] = total_duration > 0 ? times[i] % total_duration : 0;
+        }
+    }
+}
+
+void AnimationBatch::resolve_steps(size_t begin, size_t end) {
+    // After this many steps a binary search is faster than going on linearly
+    const int MAX_LINEAR_STEPS = 4;
+
+    const Ticks* end_times = step_end_times.data();
+
+    for (size_t i = begin; i < end; ++i) {
+        glm::u32 anim = instance_anim[i];
+        glm::u32 first = anim_first_step[anim];
+        glm::u32 last = anim_first_step[anim + 1] - 1;
+        glm::u32 step = instance_step[i];
+        Ticks time = instance_time[i];
+
+        // The animation started over since the last update
+        if (step > first && time < end_times[step - 1]) {
+            step = first;
+        }
+
+        // Usually the instance is still in the same step or in the next one
+        for (int n = 0; step < last && time >= end_times[step]; ++n) {
+            if (n == MAX_LINEAR_STEPS) {
+                step = static_cast<glm::u32>(
+                    std::upper_bound(end_times + step, end_times + last,
+                                     time) -
+                    end_times);
+                break;
+            }
+            ++step;
+        }
+
+        instance_step[i] = step;
+        sprite_indices[i] = step_sprite_indices[step];
+    }
+}
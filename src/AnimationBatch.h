@@ -0,0 +1,65 @@
+#pragma once
+#include "pch.h"
+#include "Animation.h"
+
+class ThreadPool;
+
+// Plays back many instances of the animations of one sheet at once, with the
+// same timing as AnimationPreview. The state of the instances is stored as
+// one array per member, so update() can run through all of them in a few
+// tight loops that the compiler can vectorize.
+class AnimationBatch {
+    // The steps of all animations are flattened into one array. The steps of
+    // animation a are [anim_first_step[a], anim_first_step[a + 1]).
+    std::vector<glm::u32> anim_first_step;
+    std::vector<Ticks> anim_total_duration;
+    // Same as Animation::step_end_times, relative to the start of the
+    // animation the step belongs to
+    std::vector<Ticks> step_end_times;
+    std::vector<glm::i32> step_sprite_indices;
+
+    // Per instance state
+    std::vector<glm::u32> instance_anim;
+    // Index into the flattened step arrays
+    std::vector<glm::u32> instance_step;
+    std::vector<Ticks> instance_time;
+    // Copy of anim_total_duration so advancing the time doesn't need to look
+    // up the animation
+    std::vector<Ticks> instance_total_duration;
+    std::vector<glm::i32> sprite_indices;
+
+    void advance_time(Ticks delta_time, size_t begin, size_t end);
+    void resolve_steps(size_t begin, size_t end);
+
+  public:
+    // Copies the steps of the animations, which have to be loaded already
+    // and have an up to date timeline.
+    // Has to be called again after the steps changed, existing instances
+    // restart in that case and have to refer to animations that still exist.
+    void set_animations(const std::vector<Animation>& animations);
+
+    // Returns the id of the new instance
+    size_t add_instance(size_t anim_index, Ticks start_time = 0);
+    void clear_instances();
+    size_t num_instances() const { return instance_anim.size(); }
+
+    // Jumps to any time in the animation of the instance, like
+    // AnimationPreview::seek()
+    void seek(size_t instance, Ticks time);
+
+    // Advances every instance by delta_time, which can't be more than
+    // MAX_TICKS
+    void update(Ticks delta_time);
+    // Same as update(), but the instances are split into chunks that are
+    // updated on the threads of pool. The instances don't depend on each
+    // other, so the result is exactly the same.
+    void update_parallel(Ticks delta_time, ThreadPool& pool);
+
+    // Sprite index of every instance, ordered by instance id. Only changes
+    // in update().
+    const glm::i32* get_sprite_indices() const { return sprite_indices.data(); }
+    Ticks get_time(size_t instance) const { return instance_time[instance]; }
+    // Ticks until the next instance starts a new step, or 0 if none of them
+    // ever changes
+    Ticks get_ticks_to_next_step() const;
+};
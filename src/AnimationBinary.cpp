@@ -0,0 +1,216 @@
+#pragma once
+#include "pch.h"
+#include "AnimationBinary.h"
+
+static size_t align_to_8(size_t offset) { return (offset + 7) & ~size_t(7); }
+
+// True if count elements of T starting at offset are inside of a file of
+// size bytes. Nothing in here can overflow, whatever is in the header.
+template <typename T>
+static bool fits_in_file(glm::u64 offset, glm::u64 count, size_t size) {
+    return offset <= size && count <= (size - offset) / sizeof(T);
+}
+
+bool MappedAnimationSheet::open(const char* path) {
+    close();
+
+    if (!file.open(path)) {
+        return false;
+    }
+
+    const char* data = file.data();
+    size_t size = file.size();
+
+    if (size < sizeof(AnimbHeader)) {
+        close();
+        return false;
+    }
+    header = reinterpret_cast<const AnimbHeader*>(data);
+
+    if (memcmp(header->magic, ANIMB_MAGIC, sizeof(ANIMB_MAGIC)) != 0 ||
+        header->version != ANIMB_VERSION) {
+        close();
+        return false;
+    }
+
+    // Make sure every table lies completely inside of the file, so the
+    // accessors don't need to check anything.
+    if (!fits_in_file<char>(sizeof(AnimbHeader), header->png_name_length,
+                            size) ||
+        header->animations_offset % 8 != 0 ||
+        !fits_in_file<AnimbAnimationEntry>(header->animations_offset,
+                                           header->num_animations, size) ||
+        header->steps_offset % 8 != 0 ||
+        !fits_in_file<Animation::AnimationStepData>(header->steps_offset,
+                                                    header->num_steps, size) ||
+        header->sprite_dimensions[0] <= 0 ||
+        header->sprite_dimensions[1] <= 0) {
+        close();
+        return false;
+    }
+
+    entries = reinterpret_cast<const AnimbAnimationEntry*>(
+        data + header->animations_offset);
+    steps = reinterpret_cast<const Animation::AnimationStepData*>(
+        data + header->steps_offset);
+
+    for (size_t i = 0; i < header->num_animations; ++i) {
+        const auto& entry = entries[i];
+        if (entry.first_step > header->num_steps ||
+            entry.num_steps > header->num_steps - entry.first_step ||
+            memchr(entry.name, '\0', Animation::MAX_NAME_LENGTH) == nullptr) {
+            close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void MappedAnimationSheet::close() {
+    file.close();
+    header = nullptr;
+    entries = nullptr;
+    steps = nullptr;
+}
+
+std::string_view MappedAnimationSheet::png_file_name() const {
+    SDL_assert(header);
+    return std::string_view(reinterpret_cast<const char*>(header + 1),
+                            header->png_name_length);
+}
+
+glm::ivec2 MappedAnimationSheet::sprite_dimensions() const {
+    SDL_assert(header);
+    return {header->sprite_dimensions[0], header->sprite_dimensions[1]};
+}
+
+size_t MappedAnimationSheet::num_animations() const {
+    return header ? header->num_animations : 0;
+}
+
+const char* MappedAnimationSheet::animation_name(size_t anim_index) const {
+    SDL_assert(anim_index < num_animations());
+    return entries[anim_index].name;
+}
+
+size_t MappedAnimationSheet::animation_num_steps(size_t anim_index) const {
+    SDL_assert(anim_index < num_animations());
+    return static_cast<size_t>(entries[anim_index].num_steps);
+}
+
+const Animation::AnimationStepData*
+MappedAnimationSheet::animation_steps(size_t anim_index) const {
+    SDL_assert(anim_index < num_animations());
+    return steps + entries[anim_index].first_step;
+}
+
+void AnimationSheetSnapshot::write_binary(std::vector<char>& file_buf) const {
+    size_t num_steps = 0;
+    for (const auto& anim : animations) {
+        num_steps += anim.steps.size();
+    }
+
+    AnimbHeader header = {};
+    memcpy(header.magic, ANIMB_MAGIC, sizeof(ANIMB_MAGIC));
+    header.version = ANIMB_VERSION;
+    header.sprite_dimensions[0] = sprite_dimensions.x;
+    header.sprite_dimensions[1] = sprite_dimensions.y;
+    header.num_animations = static_cast<glm::u32>(animations.size());
+    header.png_name_length = static_cast<glm::u32>(png_file_name.size());
+    header.animations_offset =
+        align_to_8(sizeof(AnimbHeader) + png_file_name.size());
+    header.steps_offset = header.animations_offset +
+                          animations.size() * sizeof(AnimbAnimationEntry);
+    header.num_steps = num_steps;
+
+    file_buf.assign(static_cast<size_t>(
+                        header.steps_offset +
+                        num_steps * sizeof(Animation::AnimationStepData)),
+                    0);
+
+    memcpy(file_buf.data(), &header, sizeof(header));
+    memcpy(file_buf.data() + sizeof(header), png_file_name.data(),
+           png_file_name.size());
+
+    auto* entries = reinterpret_cast<AnimbAnimationEntry*>(
+        file_buf.data() + header.animations_offset);
+    auto* steps = reinterpret_cast<Animation::AnimationStepData*>(
+        file_buf.data() + header.steps_offset);
+
+    glm::u64 first_step = 0;
+    for (size_t i = 0; i < animations.size(); ++i) {
+        const auto& anim = animations[i];
+
+        strncpy_s(entries[i].name, anim.name, Animation::MAX_NAME_LENGTH - 1);
+        entries[i].first_step = first_step;
+        entries[i].num_steps = anim.steps.size();
+
+        if (!anim.steps.empty()) {
+            memcpy(steps + first_step, anim.steps.data(),
+                   anim.steps.size() * sizeof(Animation::AnimationStepData));
+        }
+        first_step += anim.steps.size();
+    }
+}
+
+bool AnimationSheet::save_to_binary_file(const char* path) const {
+    // Assemble the whole file in memory so it can be written with one call
+    std::vector<char> file_buf;
+    snapshot().write_binary(file_buf);
+
+    SDL_RWops* file_ptr = SDL_RWFromFile(path, "wb");
+    if (!file_ptr) {
+        return false;
+    }
+
+    size_t written =
+        SDL_RWwrite(file_ptr, file_buf.data(), sizeof(char), file_buf.size());
+    // Closing flushes, that can fail too
+    bool success = SDL_RWclose(file_ptr) == 0 && written == file_buf.size();
+    if (!success) {
+        SDL_SetError("Can't write %s", path);
+    }
+    return success;
+}
+
+bool AnimationSheet::load_from_binary_file(const char* path) {
+    auto mapped = std::make_unique<MappedAnimationSheet>();
+    if (!mapped->open(path)) {
+        return false;
+    }
+
+    std::string_view png_name = mapped->png_file_name();
+    if (png_file_name) {
+        delete[] png_file_name;
+    }
+    png_file_name = new char[png_name.size() + 1];
+    memcpy(png_file_name, png_name.data(), png_name.size());
+    png_file_name[png_name.size()] = '\0';
+
+    locate_sprite_sheet(path);
+
+    sprite_dimensions = mapped->sprite_dimensions();
+    update_num_sprites();
+
+    animations.clear();
+    animations.resize(mapped->num_animations());
+
+    // The offset table already is the table of contents. The steps are
+    // stored exactly like they are in memory, so load_steps() copies them
+    // with a single memcpy per animation.
+    for (size_t i = 0; i < animations.size(); ++i) {
+        auto& anim = animations[i];
+        strncpy_s(anim.name, mapped->animation_name(i),
+                  Animation::MAX_NAME_LENGTH - 1);
+
+        anim.toc.num_steps = mapped->animation_num_steps(i);
+        anim.toc.offset = i;
+        anim.steps_loaded = false;
+    }
+
+    binary_source = std::move(mapped);
+    text_source.clear();
+
+    return true;
+}
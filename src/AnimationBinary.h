@@ -0,0 +1,70 @@
+#pragma once
+#include "pch.h"
+#include "Animation.h"
+#include "MappedFile.h"
+
+/*
+    AnimationSheet binary file format (.animb):
+    - AnimbHeader
+    - sprite sheet path (png_name_length chars, not null terminated)
+    - AnimbAnimationEntry[num_animations], 8 byte aligned
+    - Animation::AnimationStepData[num_steps], 8 byte aligned, the steps of
+      all animations one after another
+
+    All offsets are in bytes from the start of the file. The file is written
+    in the byte order of the machine, which is little endian on every platform
+    we care about.
+*/
+
+struct AnimbHeader {
+    char magic[4];
+    glm::u32 version;
+    glm::i32 sprite_dimensions[2];
+    glm::u32 num_animations;
+    glm::u32 png_name_length;
+    glm::u64 animations_offset;
+    glm::u64 steps_offset;
+    glm::u64 num_steps;
+};
+
+struct AnimbAnimationEntry {
+    char name[Animation::MAX_NAME_LENGTH];
+    glm::u64 first_step;
+    glm::u64 num_steps;
+};
+
+static const char ANIMB_MAGIC[4] = {'A', 'N', 'M', 'B'};
+static const glm::u32 ANIMB_VERSION = 1;
+
+// The step array is used in place, so its layout must not change without
+// bumping ANIMB_VERSION.
+static_assert(sizeof(Animation::AnimationStepData) == 8,
+              "AnimationStepData layout is part of the .animb format");
+static_assert(sizeof(AnimbHeader) == 48, "unexpected AnimbHeader padding");
+static_assert(sizeof(AnimbAnimationEntry) == 80,
+              "unexpected AnimbAnimationEntry padding");
+
+// Read-only, memory mapped .animb file. Nothing is parsed or copied, all
+// accessors point directly into the mapped file.
+class MappedAnimationSheet {
+    MappedFile file;
+
+    const AnimbHeader* header = nullptr;
+    const AnimbAnimationEntry* entries = nullptr;
+    const Animation::AnimationStepData* steps = nullptr;
+
+  public:
+    // Returns false if the file can't be mapped or is not a valid .animb file
+    // of a supported version.
+    bool open(const char* path);
+    void close();
+
+    std::string_view png_file_name() const;
+    glm::ivec2 sprite_dimensions() const;
+
+    size_t num_animations() const;
+    const char* animation_name(size_t anim_index) const;
+    size_t animation_num_steps(size_t anim_index) const;
+    const Animation::AnimationStepData*
+    animation_steps(size_t anim_index) const;
+};
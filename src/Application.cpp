@@ -1,11 +1,32 @@
 #pragma once
 #include "pch.h"
 #include "Application.h"
+#include "ImageCache.h"
+#include "Qoi.h"
 
 #ifdef _DEBUG
 #include "DebugCallback.h"
 #endif
 
+static const glm::vec4 BACKGROUND_COLOR = {0.2f, 0.2f, 0.2f, 1.0f};
+
+// Has to match how the textures store their alpha
+static void set_blend_func() {
+    if (PREMULTIPLIED_ALPHA) {
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    } else {
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+}
+
+// Reads the steps of an animation that was opened lazily. Malformed steps
+// are only found here, opening the file just skips them.
+static void load_steps(AnimationSheet& sheet, Animation& anim) {
+    if (!sheet.load_steps(anim)) {
+        printf("ERROR: Malformed steps in animation %s\n", anim.name);
+    }
+}
+
 void Application::init() {
 #ifdef _DEBUG
     printf("DEBUG MODE\n");
@@ -16,10 +37,21 @@ void Application::init() {
     // @CLEANUP: Why is this not necessary?
     // SDL_assert_always(IMG_Init(IMG_INIT_PNG) != 0);
 
+    // Sheets that were decoded before are mapped from here the next time
+    char* cache_directory = SDL_GetPrefPath("spriteAnimEditor", "ImageCache");
+    if (cache_directory) {
+        ImageCache::init(cache_directory);
+        SDL_free(cache_directory);
+    }
+
     window = SDL_CreateWindow("AnimationEditor", 10, 40, window_size.x,
                               window_size.y,
-                              SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_OPENGL);
+                              SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_OPENGL |
+                                  SDL_WINDOW_RESIZABLE);
     SDL_assert_always(window);
+    // Always room for the UI and some of the sheet
+    SDL_SetWindowMinimumSize(window, default_ui_size.x + 100,
+                             default_ui_size.y);
 
     sdl_renderer = SDL_CreateRenderer(window, -1, 0);
 
@@ -50,13 +82,15 @@ void Application::init() {
     }
 
     //          OpenGL configuration        //
-    if (SDL_GL_SetSwapInterval(1) < 0) {
+    bool vsync = SDL_GL_SetSwapInterval(1) == 0;
+    if (!vsync) {
         printf("Warning: Unable to set VSync! SDL Error: %s\n", SDL_GetError());
     }
+    pacer.start(60, vsync);
 
     glViewport(0, 0, window_size.x, window_size.y);
     glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    set_blend_func();
 
 #ifdef _DEBUG
     glEnable(GL_DEBUG_OUTPUT);
@@ -78,8 +112,8 @@ void Application::init() {
     default_shader =
         Shader("../src/shaders/default.vert", "../src/shaders/default.frag");
 
-    sheet_shader =
-        SheetShader("../src/shaders/sheet.vert", "../src/shaders/sheet.frag");
+    batch_shader =
+        Shader("../src/shaders/batch.vert", "../src/shaders/batch.frag");
 
     line_shader =
         LineShader("../src/shaders/line.vert", "../src/shaders/line.frag");
@@ -95,7 +129,7 @@ void Application::init() {
     sprite_vertices[3] = {{1.0f, 1.0f}, {1.0f, 1.0f}};
 
     glGenVertexArrays(1, &sprite_vao);
-    glBindVertexArray(sprite_vao);
+    GLState::bind_vertex_array(sprite_vao);
 
     GLuint vbo;
     glGenBuffers(1, &vbo);
@@ -111,37 +145,37 @@ void Application::init() {
                           (void*)sizeof(glm::vec2));
     glEnableVertexAttribArray(1);
 
-    // Init vertex buffer for line loop rendering
-    glm::vec2 line_vertices[4];
-
-    line_vertices[0] = {0.0f, 0.0f};
-    line_vertices[1] = {1.0f, 0.0f};
-    line_vertices[2] = {1.0f, 1.0f};
-    line_vertices[3] = {0.0f, 1.0f};
-
+    // The line shader generates its vertices from gl_VertexID, but the core
+    // profile still needs a vertex array to draw
     glGenVertexArrays(1, &line_vao);
-    glBindVertexArray(line_vao);
 
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(line_vertices), line_vertices,
-                 GL_STATIC_DRAW);
+    sprite_batch.init();
 
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(line_vertices[0]),
-                          (void*)0);
-    glEnableVertexAttribArray(0);
+    camera.init();
+    handle_window_resize(window_size);
+
+    playback_clock.start();
 
     is_running = true;
 }
 
 void Application::run() {
-    last_frame_start = frame_start;
-    frame_start = SDL_GetTicks();
+    if (render_on_demand && frames_to_render == 0) {
+        wait_for_changes();
+        // Waiting isn't part of the frame time
+        pacer.skip_frame();
+    }
+    if (frames_to_render > 0) {
+        --frames_to_render;
+    }
+
+    pacer.begin_frame();
 
     SDL_PumpEvents();
 
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
+        frames_to_render = FRAMES_AFTER_INPUT;
         ImGui_ImplSDL2_ProcessEvent(&event);
         if (event.type == SDL_QUIT ||
             (event.type == SDL_KEYDOWN &&
@@ -150,6 +184,11 @@ void Application::run() {
              event.window.event == SDL_WINDOWEVENT_CLOSE &&
              event.window.windowID == SDL_GetWindowID(window))) {
             is_running = false;
+        } else if (event.type == SDL_WINDOWEVENT &&
+                   event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+            handle_window_resize({event.window.data1, event.window.data2});
+        } else {
+            handle_view_input(event);
         }
     }
 
@@ -169,22 +208,83 @@ void Application::run() {
 
         if (Button("Open...")) {
             open_file();
+            skip_blocked_time();
         }
         SameLine();
         if (Button("Save")) {
             save_file(false);
+            skip_blocked_time();
         }
         SameLine();
         if (Button("Save as...")) {
             save_file(true);
+            skip_blocked_time();
+        }
+
+        if (saver.is_saving()) {
+            ProgressBar(saver.get_progress(), ImVec2(-1.0f, 0.0f),
+                        "Saving...");
+        }
+        AsyncSaver::State save_result = saver.poll();
+        if (save_result == AsyncSaver::State::FAILED) {
+            printf("ERROR: Failed to save %s\n", saver.get_path());
+        }
+        // The frame that still showed the progress bar may have been the
+        // last one
+        if (save_result == AsyncSaver::State::DONE ||
+            save_result == AsyncSaver::State::FAILED) {
+            frames_to_render = std::max(frames_to_render, 1);
+        }
+
+        // Only the .anim file knows the name of the sheet, saving it keeps
+        // the converted one
+        if (!anim_sheet.png_path.empty() &&
+            !Qoi::has_extension(anim_sheet.png_path.c_str()) &&
+            Button("Convert sheet to QOI")) {
+            convert_sheet_to_qoi();
+            skip_blocked_time();
         }
 
         Checkbox("Preview animation", &show_preview);
+        Checkbox("Preview all animations", &preview_all);
         Checkbox("Lines between sprites", &show_lines);
+        Checkbox("Render only on changes", &render_on_demand);
+
+        Text("Zoom: %.1f%%", zoom * 100.0f);
+        SameLine();
+        if (Button("Reset view")) {
+            reset_view();
+        }
+
+        Text("GL state changes: %zu, skipped: %zu", gl_stats.issued,
+             gl_stats.skipped);
+        Text("Sheet tiles uploaded: %zu",
+             sheet_texture.get_num_resident_tiles());
+        if (sheet_texture.is_loading()) {
+            SameLine();
+            Text("(loading...)");
+        }
+
+        if (CollapsingHeader("Frame times")) {
+            float histogram[FramePacer::HISTOGRAM_SIZE];
+            for (int i = 0; i < FramePacer::HISTOGRAM_SIZE; ++i) {
+                histogram[i] = static_cast<float>(pacer.get_histogram()[i]);
+            }
+            Text("Last frame: %.2f ms (%s)", pacer.get_last_frame_ms(),
+                 pacer.has_vsync() ? "vsync" : "no vsync");
+            PlotHistogram("##frame_times", histogram,
+                          FramePacer::HISTOGRAM_SIZE, 0, "1 ms per bar", 0.0f,
+                          FLT_MAX, ImVec2(0, 60));
+            if (Button("Clear")) {
+                pacer.clear_histogram();
+            }
+        }
 
         PushItemWidth(100);
         if (DragInt2("Sprite dimensions", (int*)&anim_sheet.sprite_dimensions,
                      1.0f)) {
+            // Dimensions the user chose aren't replaced by the grid
+            use_grid_when_decoded = false;
 
             anim_sheet.sprite_dimensions.x =
                 std::clamp(anim_sheet.sprite_dimensions.x, 0,
@@ -193,28 +293,23 @@ void Application::run() {
                 std::clamp(anim_sheet.sprite_dimensions.y, 0,
                            anim_sheet.sprite_sheet.dimensions.y);
 
-            window_size.x =
-                ui_size.x + std::max(anim_sheet.sprite_sheet.dimensions.x,
-                                     anim_sheet.sprite_dimensions.x);
+            anim_sheet.update_num_sprites();
+        }
 
-            if (show_preview) {
-                window_size.y =
-                    std::max(std::max(anim_sheet.sprite_sheet.dimensions.y,
-                                      anim_sheet.sprite_dimensions.y) +
-                                 anim_sheet.sprite_dimensions.y,
-                             default_ui_size.y);
-            } else {
-                window_size.y =
-                    std::max(std::max(anim_sheet.sprite_sheet.dimensions.y,
-                                      anim_sheet.sprite_dimensions.y),
-                             default_ui_size.y);
+        const GridDetect::Grid& grid = sheet_texture.get_detected_grid();
+        if (grid.found) {
+            Text("Detected cells: %d x %d", grid.cell_size.x,
+                 grid.cell_size.y);
+            // Sprites are only indexed by their dimensions, a grid that is
+            // offset too far can't be used
+            if (grid.fits_sprite_dimensions()) {
+                SameLine();
+                if (Button("Use")) {
+                    use_detected_grid();
+                }
             }
-            change_window_size();
-
-            anim_sheet.num_sprites = (anim_sheet.sprite_sheet.dimensions.x /
-                                      anim_sheet.sprite_dimensions.x) *
-                                     (anim_sheet.sprite_sheet.dimensions.y /
-                                      anim_sheet.sprite_dimensions.y);
+            Text("Offset: %d, %d  Padding: %d, %d", grid.offset.x,
+                 grid.offset.y, grid.padding.x, grid.padding.y);
         }
 
         NewLine();
@@ -233,6 +328,9 @@ void Application::run() {
                 bool is_selected = (selected_anim_index == i);
                 if (Selectable(anim_sheet.animations[i].name, is_selected)) {
                     selected_anim_index = i;
+                    // Steps are only read from the file once they're needed
+                    load_steps(anim_sheet,
+                               anim_sheet.animations[selected_anim_index]);
                     preview.set_animation(
                         &anim_sheet.animations[selected_anim_index]);
                 }
@@ -247,6 +345,7 @@ void Application::run() {
             anim_sheet.animations.push_back(new_anim);
             selected_anim_index = anim_sheet.animations.size() - 1;
             preview.set_animation(&anim_sheet.animations[selected_anim_index]);
+            all_previews_dirty = true;
         }
         SameLine();
         if (Button("Remove") && !anim_sheet.animations.empty()) {
@@ -256,6 +355,17 @@ void Application::run() {
             // doesn't matter anyway.
             anim_sheet.animations.erase(anim_sheet.animations.begin() +
                                         selected_anim_index);
+            all_previews_dirty = true;
+
+            // The preview pointed into the vector, point it at the animation
+            // that is now selected instead
+            if (selected_anim_index < anim_sheet.animations.size()) {
+                auto& anim = anim_sheet.animations[selected_anim_index];
+                load_steps(anim_sheet, anim);
+                preview.set_animation(&anim);
+            } else {
+                preview.set_animation(nullptr);
+            }
         }
         SameLine();
         bool set_focus = false;
@@ -285,122 +395,338 @@ void Application::run() {
 
             Separator();
 
-            char buf[32];
-            for (size_t i = 0; i < selected_anim.steps.size(); ++i) {
-                _itoa_s(static_cast<int>(i), buf, 10);
-                PushID(buf);
-
-                auto& step = selected_anim.steps[i];
-
-                InputInt("Sprite id", &step.sprite_index, 1);
-                step.sprite_index =
-                    std::clamp(step.sprite_index, 0,
-                               static_cast<int>(anim_sheet.num_sprites));
+            if (show_preview && !selected_anim.steps.empty()) {
+                // Instance i of all_previews plays animation i
+                bool seek_all_previews =
+                    preview_all && !all_previews_dirty &&
+                    selected_anim_index < all_previews.num_instances();
+
+                // In frames, like the durations
+                float time = ticks_to_frames(
+                    seek_all_previews
+                        ? all_previews.get_time(selected_anim_index)
+                        : preview.get_time());
+                float total_duration =
+                    ticks_to_frames(selected_anim.get_total_duration());
+                if (SliderFloat("Time", &time, 0.0f, total_duration, "%.1f")) {
+                    if (seek_all_previews) {
+                        all_previews.seek(selected_anim_index,
+                                          frames_to_ticks(time));
+                    } else {
+                        preview.seek(frames_to_ticks(time));
+                    }
+                }
+            }
 
-                InputFloat("Duration", &step.duration, 1.0f, 0.0f, "% .2f");
-                step.duration = std::clamp(step.duration, 0.0f, 1000.0f);
+            // An animation whose steps can't be read has none to edit. New
+            // ones would be thrown away when the file is read again.
+            if (!selected_anim.steps_loaded) {
+                TextUnformatted("The steps of this animation are malformed");
+            } else {
+                // The timeline has to be rebuilt after the steps changed
+                bool steps_changed = false;
+
+                char buf[32];
+                for (size_t i = 0; i < selected_anim.steps.size(); ++i) {
+                    _itoa_s(static_cast<int>(i), buf, 10);
+                    PushID(buf);
+
+                    auto& step = selected_anim.steps[i];
+
+                    // all_previews has its own copy of the sprite indices
+                    glm::i32 sprite_index = step.sprite_index;
+                    InputInt("Sprite id", &step.sprite_index, 1);
+                    step.sprite_index =
+                        std::clamp(step.sprite_index, 0,
+                                   static_cast<int>(anim_sheet.num_sprites));
+                    if (step.sprite_index != sprite_index) {
+                        steps_changed = true;
+                    }
+
+                    if (InputFloat("Duration", &step.duration, 1.0f, 0.0f,
+                                   "% .2f")) {
+                        steps_changed = true;
+                    }
+                    step.duration = std::clamp(step.duration, 0.0f, 1000.0f);
+
+                    if (Button("Remove")) {
+                        // NOTE: Same as above, erasing is expensive from a
+                        // std::vector, but it's ok for this simple
+                        // application.
+                        selected_anim.steps.erase(
+                            selected_anim.steps.begin() + i);
+                        steps_changed = true;
+                    }
+                    PopID();
+                }
 
-                if (Button("Remove")) {
-                    // NOTE: Same as above, erasing is expensive from a
-                    // std::vector, but it's ok for this simple application.
-                    selected_anim.steps.erase(selected_anim.steps.begin() + i);
+                if (Button("Add step")) {
+                    selected_anim.steps.push_back({0, 60.0f});
+                    steps_changed = true;
                 }
-                PopID();
-            }
 
-            if (Button("Add step")) {
-                selected_anim.steps.push_back({0, 60.0f});
+                if (steps_changed) {
+                    selected_anim.update_timeline();
+                    all_previews_dirty = true;
+                }
             }
         }
 
         End();
     }
 
-    // Update preview
-    if (show_preview) {
-        float delta_time = static_cast<float>(frame_start - last_frame_start) /
-                           static_cast<float>(frame_delay);
+    // Update preview. The clock keeps running while the preview is hidden,
+    // so it doesn't jump ahead once it's shown again.
+    Ticks delta_time = playback_clock.tick();
+    if (show_preview && preview_all) {
+        if (all_previews_dirty) {
+            update_all_previews();
+        }
+        all_previews.update(delta_time);
+    } else if (show_preview) {
         preview.update(delta_time);
     }
 
     // Rendering
-    glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+    glClearColor(BACKGROUND_COLOR.r, BACKGROUND_COLOR.g, BACKGROUND_COLOR.b,
+                 BACKGROUND_COLOR.a);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    if (anim_sheet.sprite_sheet.id != 0) {
-        // Render sprite sheet
+    // Parts of the sheet that finished loading replace their placeholders
+    if (sheet_texture.update()) {
+        sheet_layer_dirty = true;
+    }
+    if (use_grid_when_decoded && !sheet_texture.is_decoding()) {
+        use_grid_when_decoded = false;
+        use_detected_grid();
+    }
+    sheet_texture.begin_frame();
+
+    if (!sheet_texture.is_empty()) {
+        int preview_height = get_preview_height();
+        glm::ivec2 view_size = get_view_size();
+        update_sheet_layer(view_size);
+
+        // Only does anything after the window size changed
+        camera.upload();
+
+        // Render the visible part of the sprite sheet and the lines, cached
+        // in sheet_layer
         default_shader.use();
-        projection = glm::ortho(0.0f, static_cast<float>(window_size.x),
-                                static_cast<float>(window_size.y), 0.0f);
-        default_shader.set_projection(projection);
 
         glm::vec2 render_position = {static_cast<float>(ui_size.x), 0.0f};
         default_shader.set_render_position(render_position);
+        default_shader.set_texel_scale({1.0f, 1.0f});
 
-        glBindVertexArray(sprite_vao);
+        GLState::bind_texture(sheet_layer.texture.id);
+        GLState::bind_vertex_array(sprite_vao);
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
-        glm::i32 sprites_per_row = anim_sheet.sprite_sheet.dimensions.x /
-                                   anim_sheet.sprite_dimensions.x;
+        // Render preview below the view, every sprite of it with one draw
+        // call per tile of the sheet they are on
+        if (preview_height > 0) {
+            sprite_batch.clear();
+
+            render_position.y += view_size.y;
+            glm::vec2 sprite_size =
+                static_cast<glm::vec2>(anim_sheet.sprite_dimensions);
+
+            if (preview_all) {
+                const glm::i32* sprite_indices =
+                    all_previews.get_sprite_indices();
+
+                // Rows below the bottom of the window aren't drawn
+                size_t previews_per_row = get_previews_per_row();
+                size_t visible_rows =
+                    (preview_height + anim_sheet.sprite_dimensions.y - 1) /
+                    anim_sheet.sprite_dimensions.y;
+                size_t num_visible = std::min(all_previews.num_instances(),
+                                              visible_rows * previews_per_row);
+
+                for (size_t i = 0; i < num_visible; ++i) {
+                    glm::vec2 offset = {
+                        static_cast<float>(i % previews_per_row),
+                        static_cast<float>(i / previews_per_row)};
+
+                    // The other animations are darkened to show which one is
+                    // selected
+                    glm::vec4 tint = {1.0f, 1.0f, 1.0f, 1.0f};
+                    if (i != selected_anim_index) {
+                        tint = {0.6f, 0.6f, 0.6f, 1.0f};
+                    }
+
+                    sheet_texture.add_sprite(
+                        sprite_batch, render_position + offset * sprite_size,
+                        sprite_indices[i], anim_sheet.sprite_dimensions, tint);
+                }
+            } else if (selected_anim_index < anim_sheet.animations.size()) {
+                sheet_texture.add_sprite(sprite_batch, render_position,
+                                         preview.get_sprite_index(),
+                                         anim_sheet.sprite_dimensions);
+            }
 
-        // Render preview
-        if (show_preview &&
-            selected_anim_index < anim_sheet.animations.size()) {
-            sheet_shader.use();
-            sheet_shader.set_projection(projection);
+            batch_shader.use();
+            sprite_batch.draw();
+        }
+    }
 
-            render_position.y += anim_sheet.sprite_sheet.dimensions.y;
-            sheet_shader.set_render_position(render_position);
+    // ImGui restores the program, vertex array and texture it changes, so the
+    // GL state cache stays valid
+    ImGui::Render();
+    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
-            sheet_shader.set_sprite_dimensions(
-                static_cast<glm::vec2>(anim_sheet.sprite_dimensions));
+    gl_stats = GLState::end_frame();
 
-            glm::i32 sprite_index = preview.get_sprite_index();
+    SDL_GL_SwapWindow(window);
 
-            glm::vec2 sprite_pos_on_sheet = {
-                static_cast<float>(sprite_index % sprites_per_row),
-                static_cast<float>(sprite_index / sprites_per_row)};
+    pacer.end_frame();
+}
 
-            sheet_shader.set_sprite_position_on_sheet(sprite_pos_on_sheet);
+void Application::update_sheet_layer(glm::ivec2 view_size) {
+    // Lines closer together than this would hide the sheet, they are left
+    // out. Also limits the number of lines to the size of the view.
+    const float MIN_LINE_SPACING = 4.0f;
 
-            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    if (!sheet_layer_dirty && sheet_layer.texture.dimensions == view_size &&
+        sheet_layer_view_position == view_position &&
+        sheet_layer_zoom == zoom &&
+        sheet_layer_sprite_dimensions == anim_sheet.sprite_dimensions &&
+        sheet_layer_show_lines == show_lines) {
+        return;
+    }
+    sheet_layer_dirty = false;
+    sheet_layer_view_position = view_position;
+    sheet_layer_zoom = zoom;
+    sheet_layer_sprite_dimensions = anim_sheet.sprite_dimensions;
+    sheet_layer_show_lines = show_lines;
+
+    // The layer only covers the view, so redrawing it costs the same for
+    // any size of sheet
+    sheet_layer.resize(view_size);
+    sheet_layer.bind();
+    camera.begin_offscreen(view_size, view_position, zoom);
+
+    // The layer is opaque, cleared to the same color as the window.
+    // Premultiplied blending keeps it that way, straight alpha would make it
+    // translucent where the sheet is unless the alpha is blended differently.
+    glClearColor(BACKGROUND_COLOR.r, BACKGROUND_COLOR.g, BACKGROUND_COLOR.b,
+                 BACKGROUND_COLOR.a);
+    glClear(GL_COLOR_BUFFER_BIT);
+    if (!PREMULTIPLIED_ALPHA) {
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE,
+                            GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+    // Render the tiles of the sprite sheet that are in view. Their quads
+    // can still reach out of it, but that part is clipped before any of
+    // their pixels are shaded.
+    glm::vec2 view_end = view_position + glm::vec2(view_size) / zoom;
+
+    default_shader.use();
+    GLState::bind_vertex_array(sprite_vao);
+    sheet_texture.draw(default_shader, view_position, view_end, zoom);
+
+    // Render the lines around the sprites that are at least partly visible
+    glm::vec2 sprite_size =
+        static_cast<glm::vec2>(anim_sheet.sprite_dimensions);
+    if (show_lines && anim_sheet.num_sprites > 0 &&
+        std::min(sprite_size.x, sprite_size.y) * zoom >= MIN_LINE_SPACING) {
+        line_shader.use();
+        line_shader.set_sprite_dimensions(sprite_size);
+        line_shader.set_color(glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
+        line_shader.set_render_position({0.0f, 0.0f});
+
+        glm::ivec2 grid_size =
+            anim_sheet.sprite_sheet.dimensions / anim_sheet.sprite_dimensions;
+
+        glm::ivec2 first_cell =
+            glm::clamp(glm::ivec2(glm::floor(view_position / sprite_size)),
+                       glm::ivec2(0), grid_size);
+        glm::ivec2 end_cell =
+            glm::clamp(glm::ivec2(glm::ceil(view_end / sprite_size)),
+                       first_cell, grid_size);
+        glm::ivec2 visible_cells = end_cell - first_cell;
+        line_shader.set_grid_range(first_cell, visible_cells);
+
+        // All visible lines in one draw call
+        GLState::bind_vertex_array(line_vao);
+        if (visible_cells.x > 0 && visible_cells.y > 0) {
+            glDrawArrays(GL_LINES, 0,
+                         LineShader::get_grid_vertex_count(visible_cells));
         }
+    }
 
-        // Render lines
-        if (show_lines) {
-            line_shader.use();
-            line_shader.set_projection(projection);
-            line_shader.set_sprite_dimensions(
-                static_cast<glm::vec2>(anim_sheet.sprite_dimensions));
-            line_shader.set_color(glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
+    set_blend_func();
+    camera.end_offscreen();
+    RenderTarget::bind_window(window_size);
+}
 
-            glBindVertexArray(line_vao);
+void Application::skip_blocked_time() {
+    // The preview continues where it was instead of jumping ahead, and the
+    // frame isn't counted as a slow one
+    playback_clock.skip();
+    pacer.skip_frame();
+}
 
-            for (glm::i32 i = 0;
-                 i < static_cast<glm::i32>(anim_sheet.num_sprites); ++i) {
+void Application::wait_for_changes() {
+    // Often enough for the progress bar and to show a decoded sheet
+    const int POLL_INTERVAL = 50;
 
-                glm::vec2 position;
-                position.x = static_cast<float>(
-                    ui_size.x +
-                    i % sprites_per_row * anim_sheet.sprite_dimensions.x);
-                position.y = static_cast<float>(i / sprites_per_row *
-                                                anim_sheet.sprite_dimensions.y);
+    int timeout = -1;
+    if (saver.is_saving() || sheet_texture.is_decoding()) {
+        timeout = POLL_INTERVAL;
+    }
+    // The uploads only make progress in frames that are drawn. A save that
+    // finished after the last frame is only reported by the next one, this
+    // is checked after is_saving() so it can't be missed in between.
+    if (sheet_texture.has_pending_uploads() || saver.has_result()) {
+        timeout = 0;
+    }
 
-                line_shader.set_render_position(position);
-                glDrawArrays(GL_LINE_LOOP, 0, 4);
-            }
+    if (show_preview && !sheet_texture.is_empty()) {
+        Ticks ticks = preview_all ? all_previews.get_ticks_to_next_step()
+                                  : preview.get_ticks_to_next_step();
+        if (ticks > 0) {
+            // Waking up early would only draw the same frame again
+            int ms = ticks_to_ms(ticks);
+            timeout = timeout < 0 ? ms : std::min(timeout, ms);
         }
     }
 
-    ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    // The preview plays on through the wait, it isn't a stall
+    playback_clock.expect_wait(timeout);
 
-    SDL_GL_SwapWindow(window);
+    // The event stays in the queue and is handled in run()
+    if (timeout < 0) {
+        SDL_WaitEvent(nullptr);
+    } else {
+        SDL_WaitEventTimeout(nullptr, timeout);
+    }
+}
 
-    // Wait for next frame
-    glm::u32 last_frame_time = SDL_GetTicks() - frame_start;
-    if (frame_delay > last_frame_time)
-        SDL_Delay(frame_delay - last_frame_time);
+void Application::update_all_previews() {
+    // The batch copies the steps of every animation
+    if (!anim_sheet.load_all_steps()) {
+        printf("ERROR: Malformed steps, can't preview all animations\n");
+        preview_all = false;
+        return;
+    }
+
+    // The previews go on where they were, unless animations were added or
+    // removed
+    std::vector<Ticks> times;
+    if (all_previews.num_instances() == anim_sheet.animations.size()) {
+        for (size_t i = 0; i < all_previews.num_instances(); ++i) {
+            times.push_back(all_previews.get_time(i));
+        }
+    }
+
+    all_previews.clear_instances();
+    all_previews.set_animations(anim_sheet.animations);
+    for (size_t i = 0; i < anim_sheet.animations.size(); ++i) {
+        all_previews.add_instance(i, times.empty() ? 0 : times[i]);
+    }
+    all_previews_dirty = false;
 }
 
 void Application::open_file() {
@@ -417,7 +743,8 @@ void Application::open_file() {
 
     SDL_assert_always(SUCCEEDED(hr));
 
-    COMDLG_FILTERSPEC file_type = {L".png, .anim", L"*.png; *.anim"};
+    COMDLG_FILTERSPEC file_type = {L".png, .qoi, .anim, .animb",
+                                   L"*.png; *.qoi; *.anim; *.animb"};
     pFileOpen->SetFileTypes(1, &file_type);
 
     // Show the Open dialog box.
@@ -457,42 +784,76 @@ void Application::open_file() {
     const char* extension = strrchr(new_path, '.');
     SDL_assert_always(extension);
 
+    bool is_image =
+        strcmp(extension, ".png") == 0 || strcmp(extension, ".qoi") == 0;
+    if (!is_image) {
+        bool loaded;
+        if (strcmp(extension, ".animb") == 0) {
+            loaded = anim_sheet.load_from_binary_file(new_path);
+        } else {
+            loaded = anim_sheet.load_from_text_file(new_path);
+        }
+
+        // The sheet that was open stays, and so does its path. Saving it to
+        // the file that couldn't be read would overwrite that.
+        if (!loaded) {
+            printf("ERROR: %s is not a valid %s file\n", new_path,
+                   extension);
+            delete[] new_path;
+            return;
+        }
+    }
+
     if (opened_path) {
         delete[] opened_path;
         opened_path = nullptr;
     }
 
-    if (strcmp(extension, ".png") == 0) {
+    // Only sheets without animations get new sprite dimensions, the steps of
+    // the others would point at other sprites
+    use_grid_when_decoded = is_image;
+    if (is_image) {
         anim_sheet.create_new_from_png(new_path);
+        delete[] new_path;
     } else {
-        opened_path = new char[path_length];
-        strncpy_s(opened_path, path_length, new_path, path_length);
-
-        anim_sheet.load_from_text_file(new_path);
-
-        if (anim_sheet.animations.size() > 0) {
-            selected_anim_index = 0;
-            preview.set_animation(&anim_sheet.animations[0]);
-        }
+        opened_path = new_path;
     }
 
-    glBindTexture(GL_TEXTURE_2D, anim_sheet.sprite_sheet.id);
-
-    window_size.x = anim_sheet.sprite_sheet.dimensions.x + ui_size.x;
-
-    if (show_preview) {
-        window_size.y = std::max(anim_sheet.sprite_sheet.dimensions.y +
-                                     anim_sheet.sprite_dimensions.y,
-                                 default_ui_size.y);
+    if (anim_sheet.animations.size() > 0) {
+        selected_anim_index = 0;
+        load_steps(anim_sheet, anim_sheet.animations[0]);
+        preview.set_animation(&anim_sheet.animations[0]);
     } else {
-        window_size.y =
-            std::max(anim_sheet.sprite_sheet.dimensions.y, default_ui_size.y);
+        preview.set_animation(nullptr);
     }
 
-    change_window_size();
+    all_previews_dirty = true;
+
+    // Loading the sheet only located the image and read its dimensions. It's
+    // decoded in the background, a placeholder is drawn until then.
+    sheet_texture.start_loading(anim_sheet.png_path.c_str(),
+                                anim_sheet.sprite_sheet.dimensions);
+    sheet_layer_dirty = true;
+
+    reset_view();
 }
 
 void Application::save_file(bool get_new_path) {
+    // The snapshot that is saved needs every step. Saving without the ones
+    // that can't be read would lose them. Also unmaps an opened .animb file,
+    // which can't be replaced while it's mapped.
+    if (!anim_sheet.load_all_steps()) {
+        printf("ERROR: Malformed steps, the sheet can't be saved\n");
+        return;
+    }
+    // .animb files like that are rejected when they are opened, and no
+    // sprite could be shown with them anyway
+    if (anim_sheet.sprite_dimensions.x <= 0 ||
+        anim_sheet.sprite_dimensions.y <= 0) {
+        printf("ERROR: Sprite dimensions of 0, the sheet can't be saved\n");
+        return;
+    }
+
     if (get_new_path || opened_path == nullptr) {
         // Get a new path
         HRESULT hr = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED |
@@ -507,8 +868,9 @@ void Application::save_file(bool get_new_path) {
 
         SDL_assert_always(SUCCEEDED(hr));
 
-        COMDLG_FILTERSPEC file_type = {L".anim", L"*.anim"};
-        pFileSave->SetFileTypes(1, &file_type);
+        COMDLG_FILTERSPEC file_types[] = {{L".anim", L"*.anim"},
+                                          {L".animb", L"*.animb"}};
+        pFileSave->SetFileTypes(2, file_types);
 
         pFileSave->SetDefaultExtension(L".anim");
         pFileSave->SetFolder(animations_directory);
@@ -549,14 +911,154 @@ void Application::save_file(bool get_new_path) {
         CoUninitialize();
     }
 
-    anim_sheet.save_to_text_file(opened_path);
+    // The file is written on a worker thread, so big sheets don't stall the
+    // editor. The progress is shown in the UI.
+    if (!saver.start(anim_sheet, opened_path)) {
+        printf("Warning: Still saving %s, try again later\n",
+               saver.get_path());
+    }
+}
+
+void Application::convert_sheet_to_qoi() {
+    const std::string& png_path = anim_sheet.png_path;
+    // Same as the path the sheet gets below
+    std::string qoi_path = png_path;
+    replace_extension(qoi_path, ".qoi");
+
+    // Another image with that name may be used by other sheets
+    SDL_RWops* existing = SDL_RWFromFile(qoi_path.c_str(), "rb");
+    if (existing) {
+        SDL_RWclose(existing);
+        printf("ERROR: %s already exists\n", qoi_path.c_str());
+        return;
+    }
+
+    // The sheet texture only has the premultiplied pixels, the file gets the
+    // ones of the original image
+    SDL_Surface* img = load_image(png_path.c_str());
+    if (!img) {
+        printf("ERROR: Can't load %s: %s\n", png_path.c_str(), SDL_GetError());
+        return;
+    }
+    bool saved = Qoi::save(img, qoi_path.c_str());
+    SDL_FreeSurface(img);
+
+    if (!saved) {
+        printf("ERROR: Can't convert %s: %s\n", png_path.c_str(),
+               SDL_GetError());
+        return;
+    }
+    // Same pixels, so the texture doesn't have to be loaded again
+    anim_sheet.replace_sprite_sheet_extension(".qoi");
+    printf("Converted the sprite sheet to %s\n", qoi_path.c_str());
 }
 
-void Application::change_window_size() {
-    SDL_assert(window_size.x >= default_ui_size.x &&
-               window_size.y >= default_ui_size.y);
-    SDL_SetWindowSize(window, window_size.x, window_size.y);
+void Application::use_detected_grid() {
+    const GridDetect::Grid& grid = sheet_texture.get_detected_grid();
+    if (!grid.fits_sprite_dimensions()) {
+        return;
+    }
+    // Each sprite is a whole cell with the padding after it
+    anim_sheet.sprite_dimensions = grid.pitch;
+    anim_sheet.update_num_sprites();
+}
+
+void Application::handle_window_resize(glm::ivec2 size) {
+    window_size = size;
     glViewport(0, 0, window_size.x, window_size.y);
+    camera.set_window_size(window_size);
 
     ui_size.y = window_size.y;
+}
+
+void Application::handle_view_input(const SDL_Event& event) {
+    // Zooming in and out again by the same number of steps gets back to the
+    // same zoom
+    const float ZOOM_STEP = 1.25f;
+
+    // Input over the UI is handled by ImGui
+    bool over_ui = ImGui::GetIO().WantCaptureMouse;
+
+    if (event.type == SDL_MOUSEWHEEL && !over_ui && event.wheel.y != 0) {
+        int x, y;
+        SDL_GetMouseState(&x, &y);
+        glm::vec2 cursor = {static_cast<float>(x - ui_size.x),
+                            static_cast<float>(y)};
+        glm::vec2 view_size = get_view_size();
+
+        if (cursor.x >= 0.0f && cursor.y < view_size.y) {
+            float steps = static_cast<float>(event.wheel.y);
+            zoom_at(cursor, zoom * std::pow(ZOOM_STEP, steps));
+        }
+    } else if (event.type == SDL_MOUSEBUTTONDOWN && !over_ui &&
+               (event.button.button == SDL_BUTTON_RIGHT ||
+                event.button.button == SDL_BUTTON_MIDDLE)) {
+        is_panning = event.button.x >= ui_size.x &&
+                     event.button.y < get_view_size().y;
+    } else if (event.type == SDL_MOUSEBUTTONUP &&
+               (event.button.button == SDL_BUTTON_RIGHT ||
+                event.button.button == SDL_BUTTON_MIDDLE)) {
+        is_panning = false;
+    } else if (event.type == SDL_MOUSEMOTION && is_panning) {
+        glm::vec2 motion = {static_cast<float>(event.motion.xrel),
+                            static_cast<float>(event.motion.yrel)};
+        view_position -= motion / zoom;
+    }
+}
+
+void Application::zoom_at(glm::vec2 screen_position, float new_zoom) {
+    new_zoom = std::clamp(new_zoom, MIN_ZOOM, MAX_ZOOM);
+
+    glm::vec2 sheet_position = view_position + screen_position / zoom;
+    view_position = sheet_position - screen_position / new_zoom;
+    zoom = new_zoom;
+}
+
+void Application::reset_view() {
+    view_position = {0.0f, 0.0f};
+    zoom = 1.0f;
+
+    glm::vec2 view_size = get_view_size();
+    glm::vec2 sheet_size = anim_sheet.sprite_sheet.dimensions;
+    if (sheet_size.x > 0.0f && sheet_size.y > 0.0f) {
+        zoom = std::min({1.0f, view_size.x / sheet_size.x,
+                         view_size.y / sheet_size.y});
+        zoom = std::max(zoom, MIN_ZOOM);
+    }
+}
+
+glm::ivec2 Application::get_view_size() const {
+    return {std::max(window_size.x - ui_size.x, 1),
+            std::max(window_size.y - get_preview_height(), 1)};
+}
+
+size_t Application::get_previews_per_row() const {
+    // As many in a row as fit next to the UI
+    if (anim_sheet.sprite_dimensions.x <= 0) {
+        return 1;
+    }
+    return static_cast<size_t>(std::max(
+        (window_size.x - ui_size.x) / anim_sheet.sprite_dimensions.x, 1));
+}
+
+int Application::get_preview_height() const {
+    int sprite_height = anim_sheet.sprite_dimensions.y;
+    if (!show_preview || sheet_texture.is_empty() ||
+        sprite_height <= 0) {
+        return 0;
+    }
+
+    size_t rows = 1;
+    if (preview_all) {
+        size_t previews_per_row = get_previews_per_row();
+        rows = std::max<size_t>(
+            (anim_sheet.animations.size() + previews_per_row - 1) /
+                previews_per_row,
+            1);
+    }
+
+    // The rest of the rows are cut off, the view needs some room too
+    return static_cast<int>(
+        std::min(rows * sprite_height,
+                 static_cast<size_t>(window_size.y / 2)));
 }
\ No newline at end of file
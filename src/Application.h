@@ -3,26 +3,66 @@
 #include "Shader.h"
 #include "Texture.h"
 #include "Animation.h"
+#include "AnimationBatch.h"
+#include "AsyncSaver.h"
+#include "CameraBuffer.h"
+#include "FramePacer.h"
+#include "PlaybackClock.h"
+#include "RenderTarget.h"
+#include "SpriteBatch.h"
+#include "TiledTexture.h"
 
 class Application {
     SDL_Window* window;
     SDL_Renderer* sdl_renderer;
     SDL_GLContext gl_context;
 
-    glm::u32 last_frame_start, frame_start;
-    glm::u32 frame_delay = 1000 / 60;
+    FramePacer pacer;
+    // Drives the animation preview
+    PlaybackClock playback_clock;
 
     Shader default_shader;
-    SheetShader sheet_shader;
+    Shader batch_shader;
     LineShader line_shader;
 
-    glm::mat4 projection;
+    SpriteBatch sprite_batch;
+
+    // The image of anim_sheet, which is only used for its dimensions
+    TiledTexture sheet_texture;
+    // Set for sheets that were created from an image, their sprite
+    // dimensions are replaced by the detected grid once it's decoded. Unless
+    // they were changed in the UI before that.
+    bool use_grid_when_decoded = false;
+
+    // The visible part of the sprite sheet with the lines drawn over it, as
+    // big as the view. Only redrawn when the view, the texture, the sprite
+    // dimensions or show_lines changed.
+    RenderTarget sheet_layer;
+    bool sheet_layer_dirty = true;
+    glm::vec2 sheet_layer_view_position;
+    float sheet_layer_zoom;
+    glm::ivec2 sheet_layer_sprite_dimensions;
+    bool sheet_layer_show_lines;
+
+    // Of the last frame, shown in the UI
+    GLState::Stats gl_stats;
+
+    CameraBuffer camera;
 
     GLuint sprite_vao, line_vao;
 
     const glm::ivec2 default_ui_size = {300, 500};
     glm::ivec2 ui_size = default_ui_size;
-    glm::ivec2 window_size = ui_size;
+    glm::ivec2 window_size = {1280, 720};
+
+    // The sheet is shown right of the UI and above the preview.
+    // view_position is the point of the sheet in the top left corner of the
+    // view, zoom the size of a sheet pixel on screen.
+    glm::vec2 view_position = {0.0f, 0.0f};
+    float zoom = 1.0f;
+    bool is_panning = false;
+    static constexpr float MIN_ZOOM = 1.0f / 16.0f;
+    static constexpr float MAX_ZOOM = 32.0f;
 
     // Animation Editor stuff
     size_t selected_anim_index;
@@ -30,16 +70,47 @@ class Application {
     AnimationSheet anim_sheet;
 
     AnimationPreview preview;
+    // One instance per animation when all of them are previewed at once.
+    // Rebuilt when the animations changed.
+    AnimationBatch all_previews;
+    bool all_previews_dirty = true;
+
+    AsyncSaver saver;
 
     char* opened_path = nullptr;
     IShellItem* animations_directory = nullptr;
 
     bool show_preview = true;
     bool show_lines = true;
+    bool preview_all = false;
+
+    // Only draw frames after input, at the next step of a playing preview or
+    // while a save is running. Saves the CPU from drawing the same frame over
+    // and over.
+    bool render_on_demand = true;
+    // Frames that are still drawn before waiting again, ImGui needs a few
+    // frames after input to settle
+    int frames_to_render = 0;
+    static const int FRAMES_AFTER_INPUT = 3;
 
+    void wait_for_changes();
+    void handle_view_input(const SDL_Event& event);
+    // Keeps the sheet point under screen_position in place
+    void zoom_at(glm::vec2 screen_position, float new_zoom);
+    // Shows the whole sheet, if that's possible without magnifying it
+    void reset_view();
+    glm::ivec2 get_view_size() const;
+    size_t get_previews_per_row() const;
+    int get_preview_height() const;
+    void update_sheet_layer(glm::ivec2 view_size);
+    // Called after something blocked the main loop, like a file dialog
+    void skip_blocked_time();
+    void update_all_previews();
     void open_file();
     void save_file(bool get_new_path);
-    void change_window_size();
+    void convert_sheet_to_qoi();
+    void use_detected_grid();
+    void handle_window_resize(glm::ivec2 size);
 
   public:
     void init();
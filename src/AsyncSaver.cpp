@@ -0,0 +1,97 @@
+#pragma once
+#include "pch.h"
+#include "AsyncSaver.h"
+#include "TextIO.h"
+
+// The file is written in chunks of this size, so progress can be reported
+static const size_t WRITE_CHUNK_SIZE = 1024 * 1024;
+
+AsyncSaver::~AsyncSaver() {
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+bool AsyncSaver::start(const AnimationSheet& sheet, const char* new_path) {
+    if (is_saving()) {
+        return false;
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+
+    path = new_path;
+    const char* extension = strrchr(new_path, '.');
+    bool binary = extension && strcmp(extension, ".animb") == 0;
+
+    progress = 0.0f;
+    state = State::SAVING;
+    worker = std::thread(&AsyncSaver::save, this, sheet.snapshot(), binary);
+
+    return true;
+}
+
+void AsyncSaver::save(AnimationSheetSnapshot snapshot, bool binary) {
+    bool success;
+    if (binary) {
+        std::vector<char> file_buf;
+        snapshot.write_binary(file_buf);
+        success = write_file(file_buf.data(), file_buf.size());
+    } else {
+        TextWriter writer;
+        snapshot.write_text(writer);
+        success = write_file(writer.data(), writer.size());
+    }
+
+    state = success ? State::DONE : State::FAILED;
+}
+
+bool AsyncSaver::write_file(const char* data, size_t size) {
+    std::string temp_path = path + ".tmp";
+
+    HANDLE file = CreateFileA(temp_path.c_str(), GENERIC_WRITE, 0, NULL,
+                              CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    size_t bytes_written = 0;
+    bool success = true;
+    while (bytes_written < size) {
+        DWORD chunk_size = static_cast<DWORD>(
+            std::min(size - bytes_written, WRITE_CHUNK_SIZE));
+        DWORD chunk_written;
+        if (!WriteFile(file, data + bytes_written, chunk_size, &chunk_written,
+                       NULL) ||
+            chunk_written != chunk_size) {
+            success = false;
+            break;
+        }
+        bytes_written += chunk_written;
+        progress = static_cast<float>(bytes_written) / static_cast<float>(size);
+    }
+
+    // Make sure the data is on disk before the rename makes it visible
+    success = success && FlushFileBuffers(file);
+    CloseHandle(file);
+
+    success = success &&
+              MoveFileExA(temp_path.c_str(), path.c_str(),
+                          MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+    if (!success) {
+        DeleteFileA(temp_path.c_str());
+        return false;
+    }
+
+    progress = 1.0f;
+    return true;
+}
+
+AsyncSaver::State AsyncSaver::poll() {
+    State current_state = state;
+    if (current_state == State::DONE || current_state == State::FAILED) {
+        worker.join();
+        state = State::IDLE;
+    }
+    return current_state;
+}
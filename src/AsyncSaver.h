@@ -0,0 +1,47 @@
+#pragma once
+#include "pch.h"
+#include "Animation.h"
+
+// Saves a snapshot of an AnimationSheet on a worker thread. The file is
+// written to "<path>.tmp" first and then renamed over the target, so a crash
+// in the middle of a save never leaves a half written file behind.
+class AsyncSaver {
+  public:
+    enum class State { IDLE, SAVING, DONE, FAILED };
+
+  private:
+    std::thread worker;
+    std::atomic<State> state = State::IDLE;
+    // From 0 to 1
+    std::atomic<float> progress = 0.0f;
+
+    std::string path;
+
+    void save(AnimationSheetSnapshot snapshot, bool binary);
+    bool write_file(const char* data, size_t size);
+
+  public:
+    AsyncSaver() {}
+    // Waits for a running save to finish
+    ~AsyncSaver();
+
+    AsyncSaver(const AsyncSaver&) = delete;
+    AsyncSaver& operator=(const AsyncSaver&) = delete;
+
+    // Takes a snapshot of the sheet and starts saving it. The format is chosen
+    // by the extension of path. Returns false if a save is still running.
+    bool start(const AnimationSheet& sheet, const char* path);
+
+    bool is_saving() const { return state == State::SAVING; }
+    // A save finished and poll() didn't return that yet
+    bool has_result() const {
+        State current_state = state;
+        return current_state == State::DONE || current_state == State::FAILED;
+    }
+    float get_progress() const { return progress; }
+    const char* get_path() const { return path.c_str(); }
+
+    // Call once per frame. Returns DONE or FAILED exactly once after a save
+    // finished, IDLE or SAVING otherwise.
+    State poll();
+};
@@ -0,0 +1,149 @@
+#pragma once
+#include "pch.h"
+#include "BatchLoader.h"
+
+BatchLoader::BatchLoader(size_t num_threads, bool upload_textures)
+    : pool(num_threads), upload_textures(upload_textures) {
+    // IMG_Load initializes the png loader lazily, which is not thread safe.
+    // Do it here before any worker decodes an image.
+    IMG_Init(IMG_INIT_PNG);
+}
+
+BatchLoader::~BatchLoader() {
+    // The workers write into the entries, they have to finish before the
+    // entries are destroyed
+    pool.wait();
+
+    for (auto& entry : entries) {
+        if (entry->image) {
+            SDL_FreeSurface(entry->image);
+        }
+    }
+}
+
+void BatchLoader::start(const std::vector<std::string>& paths) {
+    for (const auto& path : paths) {
+        size_t entry_index = entries.size();
+
+        auto entry = std::make_unique<Entry>();
+        entry->path = path;
+        entry->image_owner = entry_index;
+        {
+            std::lock_guard<std::mutex> lock(ready_mutex);
+            entries.push_back(std::move(entry));
+        }
+
+        pool.submit([this, entry_index] { load(entry_index); });
+    }
+}
+
+// Runs on a worker thread
+void BatchLoader::load(size_t entry_index) {
+    Entry* entry;
+    {
+        // start() might be adding entries at the same time
+        std::lock_guard<std::mutex> lock(ready_mutex);
+        entry = entries[entry_index].get();
+    }
+
+    const char* path = entry->path.c_str();
+    const char* extension = strrchr(path, '.');
+    if (extension && strcmp(extension, ".animb") == 0) {
+        entry->success = entry->sheet.load_from_binary_file(path);
+    } else {
+        entry->success = entry->sheet.load_from_text_file(path);
+    }
+
+    if (entry->success) {
+        entry->success = entry->sheet.load_all_steps();
+    }
+    if (entry->success) {
+        // Only the first entry that uses an image decodes it
+        bool decode;
+        {
+            std::lock_guard<std::mutex> lock(ready_mutex);
+            auto result =
+                image_owners.emplace(entry->sheet.png_path, entry_index);
+            entry->image_owner = result.first->second;
+            decode = result.second;
+        }
+
+        if (decode && upload_textures) {
+            // Converting here keeps that off the GL thread as well
+            entry->image = load_texture_image(entry->sheet.png_path.c_str(),
+                                              entry->image_file);
+            entry->image_loaded = entry->image != nullptr;
+        } else if (decode) {
+            // Nothing is uploaded, so the image isn't kept either
+            SDL_Surface* image = load_image(entry->sheet.png_path.c_str());
+            entry->image_loaded = image != nullptr;
+            if (image) {
+                SDL_FreeSurface(image);
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(ready_mutex);
+    ready.push_back(entry_index);
+}
+
+size_t BatchLoader::upload_finished(size_t max_uploads) {
+    {
+        std::lock_guard<std::mutex> lock(ready_mutex);
+        waiting.insert(waiting.end(), ready.begin(), ready.end());
+        ready.clear();
+    }
+
+    size_t num_uploads = 0;
+
+    // Images are uploaded in the first pass, entries that share an image with
+    // another entry get its texture in the second one.
+    for (int pass = 0; pass < 2; ++pass) {
+        for (auto it = waiting.begin(); it != waiting.end();) {
+            Entry& entry = *entries[*it];
+
+            if (entry.success && entry.image_owner == *it) {
+                if (pass == 1 || num_uploads == max_uploads) {
+                    ++it;
+                    continue;
+                }
+
+                if (entry.image) {
+                    entry.sheet.sprite_sheet.load_from_pixels(
+                        static_cast<const Uint8*>(entry.image->pixels),
+                        {entry.image->w, entry.image->h});
+                    SDL_FreeSurface(entry.image);
+                    entry.image = nullptr;
+                    entry.image_file.reset();
+                }
+                ++num_uploads;
+            } else if (entry.success) {
+                const Entry& owner = *entries[entry.image_owner];
+                if (!owner.uploaded) {
+                    ++it;
+                    continue;
+                }
+                entry.image_loaded = owner.image_loaded;
+                if (upload_textures) {
+                    entry.sheet.sprite_sheet.share(owner.sheet.sprite_sheet);
+                }
+            }
+
+            entry.uploaded = true;
+            ++num_uploaded;
+            it = waiting.erase(it);
+        }
+    }
+
+    return num_uploaded;
+}
+
+std::vector<std::unique_ptr<BatchLoader::Entry>> BatchLoader::take_entries() {
+    SDL_assert(is_done());
+
+    auto result = std::move(entries);
+    entries.clear();
+    num_uploaded = 0;
+    image_owners.clear();
+    return result;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "pch.h"
+#include "Animation.h"
+#include "ThreadPool.h"
+
+// Loads many animation files and their sprite sheets at once. Parsing the
+// files and decoding the images runs on a thread pool, sheets that share an
+// image decode it only once. GL calls can only be made on the thread that
+// owns the context, so the texture uploads are queued and done there by
+// calling upload_finished() (e.g. once per frame).
+// Tools without a GL context can leave out the textures, the images are then
+// only decoded to check that they can be.
+class BatchLoader {
+  public:
+    struct Entry {
+        std::string path;
+        AnimationSheet sheet;
+        bool success = false;
+        bool uploaded = false;
+        // The sprite sheet could be decoded, also set for the entries that
+        // share it with image_owner
+        bool image_loaded = false;
+
+        // Decoded sprite sheet in the format of the texture, waiting to be
+        // uploaded. Null if another entry decodes the same image (see
+        // image_owner).
+        SDL_Surface* image = nullptr;
+        // Holds the pixels of image if it came from the ImageCache
+        std::unique_ptr<MappedFile> image_file;
+        size_t image_owner;
+    };
+
+  private:
+    ThreadPool pool;
+    bool upload_textures;
+
+    std::vector<std::unique_ptr<Entry>> entries;
+    size_t num_uploaded = 0;
+    // Entries that finished loading but weren't uploaded yet, only used on
+    // the GL thread
+    std::vector<size_t> waiting;
+
+    std::mutex ready_mutex;
+    // Entries that finished on a worker and wait for upload_finished()
+    std::vector<size_t> ready;
+    // Maps the full image path to the entry that decodes it
+    std::unordered_map<std::string, size_t> image_owners;
+
+    void load(size_t entry_index);
+
+  public:
+    // num_threads == 0 uses one thread per hardware thread. Without
+    // upload_textures, upload_finished() makes no GL calls and the sheets
+    // get no texture.
+    explicit BatchLoader(size_t num_threads = 0, bool upload_textures = true);
+    // Waits for the workers and frees images that were never uploaded
+    ~BatchLoader();
+
+    // Starts loading .anim and .animb files. Can be called again to add more.
+    void start(const std::vector<std::string>& paths);
+    // Blocks until every started file was read and its image decoded, only
+    // upload_finished() is left then
+    void wait() { pool.wait(); }
+
+    // Uploads the sprite sheets of up to max_uploads entries that finished
+    // loading. Has to be called on the GL thread. Returns the number of
+    // entries that are completely loaded.
+    size_t upload_finished(size_t max_uploads = SIZE_MAX);
+
+    bool is_done() const { return num_uploaded == entries.size(); }
+
+    // Only valid once is_done() returns true. Entries that failed to load
+    // have success set to false, image_loaded tells if their sprite sheet
+    // could be decoded as well. Entries that use the same image also share
+    // its texture, only the first one of them owns it (see
+    // Texture::share()).
+    std::vector<std::unique_ptr<Entry>> take_entries();
+};
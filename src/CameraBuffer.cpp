@@ -0,0 +1,51 @@
+#pragma once
+#include "pch.h"
+#include "CameraBuffer.h"
+#include "GLState.h"
+
+void CameraBuffer::init() {
+    glGenBuffers(1, &ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(Data), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, ubo);
+    changed = true;
+}
+
+void CameraBuffer::set_window_size(glm::ivec2 size) {
+    glm::mat4 projection = glm::ortho(0.0f, static_cast<float>(size.x),
+                                      static_cast<float>(size.y), 0.0f);
+    if (projection != data.projection) {
+        data.projection = projection;
+        changed = true;
+    }
+}
+
+void CameraBuffer::upload() {
+    if (!changed) {
+        GLState::count_skipped();
+        return;
+    }
+    GLState::count_issued();
+
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Data), &data);
+    changed = false;
+}
+
+void CameraBuffer::begin_offscreen(glm::ivec2 size, glm::vec2 view_position,
+                                   float zoom) {
+    window_data = data;
+
+    data.projection = glm::ortho(0.0f, static_cast<float>(size.x), 0.0f,
+                                 static_cast<float>(size.y));
+    data.view_position = view_position;
+    data.zoom = zoom;
+    changed = true;
+    upload();
+}
+
+void CameraBuffer::end_offscreen() {
+    data = window_data;
+    changed = true;
+    upload();
+}
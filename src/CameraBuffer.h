@@ -0,0 +1,44 @@
+#pragma once
+#include "pch.h"
+
+// Projection and view shared by all shaders through the uniform block
+// "Camera". It's only uploaded when something changed, instead of once per
+// shader and frame.
+class CameraBuffer {
+  public:
+    // Layout of the uniform block, std140
+    struct Data {
+        glm::mat4 projection;
+        // Position that is shown in the top left corner of the window
+        glm::vec2 view_position;
+        float zoom;
+        float padding;
+    };
+    static_assert(sizeof(Data) == 80, "Has to match the std140 layout");
+
+    static const GLuint BINDING = 0;
+
+  private:
+    GLuint ubo = 0;
+    Data data = {glm::mat4(1.0f), {0.0f, 0.0f}, 1.0f, 0.0f};
+    bool changed = true;
+    // Camera of the window while rendering offscreen
+    Data window_data;
+
+  public:
+    // Creates the buffer and binds it to BINDING, needs a GL context
+    void init();
+
+    // Positions map 1:1 to the pixels of the window
+    void set_window_size(glm::ivec2 size);
+
+    // Uploads the data if it changed since the last upload
+    void upload();
+
+    // For rendering into a RenderTarget of the given size until
+    // end_offscreen(). view_position ends up in the top left corner of the
+    // texture and zoom is the size of a unit in texels. The Y-Axis points up
+    // so the texture doesn't have to be flipped when it's drawn.
+    void begin_offscreen(glm::ivec2 size, glm::vec2 view_position, float zoom);
+    void end_offscreen();
+};
@@ -0,0 +1,52 @@
+#pragma once
+#include "pch.h"
+#include "FramePacer.h"
+
+void FramePacer::start(int frames_per_second, bool vsync) {
+    this->vsync = vsync;
+    frequency = SDL_GetPerformanceFrequency();
+    frame_interval = frequency / frames_per_second;
+    frame_start = SDL_GetPerformanceCounter();
+    skip_next = true;
+}
+
+void FramePacer::begin_frame() {
+    glm::u64 now = SDL_GetPerformanceCounter();
+    glm::u64 elapsed = now - frame_start;
+    frame_start = now;
+
+    if (skip_next) {
+        skip_next = false;
+        return;
+    }
+
+    last_frame_ms = static_cast<float>(static_cast<double>(elapsed) * 1000.0 /
+                                       static_cast<double>(frequency));
+    int bucket = std::min(static_cast<int>(last_frame_ms), HISTOGRAM_SIZE - 1);
+    ++histogram[bucket];
+    ++num_frames;
+}
+
+void FramePacer::end_frame() {
+    if (vsync) {
+        return;
+    }
+
+    // Sleeping can overshoot by about a millisecond (with SDL's 1 ms timer
+    // resolution), the last part is spent spinning instead
+    const glm::u64 spin_time = frequency * 2 / 1000;
+
+    glm::u64 deadline = frame_start + frame_interval;
+    glm::u64 now = SDL_GetPerformanceCounter();
+    if (now + spin_time < deadline) {
+        glm::u64 sleep_time = deadline - spin_time - now;
+        SDL_Delay(static_cast<glm::u32>(sleep_time * 1000 / frequency));
+    }
+    while (SDL_GetPerformanceCounter() < deadline) {
+    }
+}
+
+void FramePacer::clear_histogram() {
+    std::fill(std::begin(histogram), std::end(histogram), 0);
+    num_frames = 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "pch.h"
+
+// Keeps frames at a steady rate using the high resolution performance
+// counter. With vsync the buffer swap already waits for the display, so the
+// pacer only measures. Without it, it sleeps until shortly before the next
+// frame is due and spins for the rest, since sleeping alone overshoots by up
+// to a millisecond. Also keeps a histogram of frame times.
+class FramePacer {
+  public:
+    // Buckets of 1 ms, the last one counts everything that's even slower
+    static const int HISTOGRAM_SIZE = 50;
+
+  private:
+    glm::u64 frequency = 1;
+    // In counter units
+    glm::u64 frame_interval = 0;
+    glm::u64 frame_start = 0;
+    bool vsync = false;
+    // The time since the last frame is not a frame time, see skip_frame()
+    bool skip_next = true;
+
+    float last_frame_ms = 0.0f;
+    glm::u32 histogram[HISTOGRAM_SIZE] = {};
+    glm::u64 num_frames = 0;
+
+  public:
+    void start(int frames_per_second, bool vsync);
+
+    // Call at the start of every frame, records the time since the last one
+    void begin_frame();
+    // Waits until the next frame is due
+    void end_frame();
+    // Leaves the time until the next begin_frame() out of the histogram, for
+    // frames that waited for input or were blocked by a modal dialog
+    void skip_frame() { skip_next = true; }
+
+    bool has_vsync() const { return vsync; }
+    float get_last_frame_ms() const { return last_frame_ms; }
+    const glm::u32* get_histogram() const { return histogram; }
+    glm::u64 get_num_frames() const { return num_frames; }
+    void clear_histogram();
+};
@@ -0,0 +1,65 @@
+#pragma once
+#include "pch.h"
+#include "GLState.h"
+
+namespace GLState {
+// Not a valid object name, so the first call always goes through
+static const GLuint UNKNOWN = 0xffffffff;
+
+static GLuint current_program = UNKNOWN;
+static GLuint current_vao = UNKNOWN;
+static GLuint current_texture = UNKNOWN;
+
+static Stats stats;
+
+// Returns true if the call has to be made
+static bool update(GLuint& current, GLuint new_value) {
+    if (current == new_value) {
+        ++stats.skipped;
+        return false;
+    }
+    current = new_value;
+    ++stats.issued;
+    return true;
+}
+
+void use_program(GLuint program) {
+    if (update(current_program, program)) {
+        glUseProgram(program);
+    }
+}
+
+void bind_vertex_array(GLuint vao) {
+    if (update(current_vao, vao)) {
+        glBindVertexArray(vao);
+    }
+}
+
+void bind_texture(GLuint texture) {
+    if (update(current_texture, texture)) {
+        glBindTexture(GL_TEXTURE_2D, texture);
+    }
+}
+
+void delete_texture(GLuint texture) {
+    glDeleteTextures(1, &texture);
+    if (current_texture == texture) {
+        current_texture = 0;
+    }
+}
+
+void invalidate() {
+    current_program = UNKNOWN;
+    current_vao = UNKNOWN;
+    current_texture = UNKNOWN;
+}
+
+void count_issued() { ++stats.issued; }
+void count_skipped() { ++stats.skipped; }
+
+Stats end_frame() {
+    Stats result = stats;
+    stats = Stats();
+    return result;
+}
+} // namespace GLState
@@ -0,0 +1,55 @@
+#pragma once
+#include "pch.h"
+
+// Remembers the program, vertex array and texture that are bound and skips
+// calls that wouldn't change them. Everything that binds these has to go
+// through here, code that doesn't (like ImGui) has to restore the state
+// afterwards or call invalidate().
+namespace GLState {
+struct Stats {
+    size_t issued = 0;
+    size_t skipped = 0;
+};
+
+void use_program(GLuint program);
+void bind_vertex_array(GLuint vao);
+// Binds to GL_TEXTURE_2D of the active texture unit, only unit 0 is used
+void bind_texture(GLuint texture);
+// A deleted texture is unbound by GL, so the cache has to know about it
+void delete_texture(GLuint texture);
+
+// Forgets everything, the next call is never skipped
+void invalidate();
+
+// For the uniform caches of the shaders, which live in the shaders since
+// uniforms are part of a program's state
+void count_issued();
+void count_skipped();
+
+// Returns the counts since the last call and starts over, called once per
+// frame
+Stats end_frame();
+} // namespace GLState
+
+// Last value sent to a uniform of a program, so sending the same value again
+// can be skipped
+template <typename T> struct CachedUniform {
+    GLint location = -1;
+    T value;
+    bool valid = false;
+
+    CachedUniform() {}
+    CachedUniform(GLint location) : location(location) {}
+
+    // Returns true if the value changed and has to be sent
+    bool update(const T& new_value) {
+        if (valid && value == new_value) {
+            GLState::count_skipped();
+            return false;
+        }
+        value = new_value;
+        valid = true;
+        GLState::count_issued();
+        return true;
+    }
+};
@@ -0,0 +1,143 @@
+#pragma once
+#include "pch.h"
+#include "GridDetect.h"
+#include "PixelConvert.h"
+
+namespace GridDetect {
+// Columns or rows that aren't empty, [begin, end)
+struct Run {
+    int begin;
+    int end;
+};
+
+// Adds one to counts in [begin, end), clipped to the size of counts. The
+// counts are differences to the previous one until they're summed up.
+static void add_range(std::vector<int>& counts, int begin, int end) {
+    int size = static_cast<int>(counts.size()) - 1;
+    begin = std::min(begin, size);
+    end = std::min(end, size);
+    if (begin < end) {
+        ++counts[begin];
+        --counts[end];
+    }
+}
+
+// Smallest cells that hold every run, for cells of pitch that start at
+// border. Returns how many cells have a run in them.
+static int shrink_cells(const std::vector<Run>& runs, int pitch, int border,
+                        int& offset, int& cell_size) {
+    int lead = pitch;
+    int trail = pitch;
+    int num_used = 0;
+    int last_cell_start = -1;
+    for (const Run& run : runs) {
+        int cell_start = border + (run.begin - border) / pitch * pitch;
+        lead = std::min(lead, run.begin - cell_start);
+        trail = std::min(trail, cell_start + pitch - run.end);
+        // The runs are sorted, so runs in the same cell follow each other
+        if (cell_start != last_cell_start) {
+            ++num_used;
+            last_cell_start = cell_start;
+        }
+    }
+    offset = border + lead;
+    cell_size = pitch - lead - trail;
+    return num_used;
+}
+
+bool detect_axis(const Uint8* occupied, int size, int& pitch, int& offset,
+                 int& cell_size) {
+    std::vector<Run> runs;
+    int max_length = 0;
+    for (int i = 0; i < size;) {
+        if (!occupied[i]) {
+            ++i;
+            continue;
+        }
+        Run run = {i, i};
+        while (run.end < size && occupied[run.end]) {
+            ++run.end;
+        }
+        runs.push_back(run);
+        max_length = std::max(max_length, run.end - run.begin);
+        i = run.end;
+    }
+    if (runs.empty()) {
+        return false;
+    }
+
+    // The first cell border is at or before the first sprite, so only
+    // those are tried
+    int first_begin = runs.front().begin;
+    // How many runs a cell border at an offset would cut through
+    std::vector<int> cuts;
+    cell_size = INT_MAX;
+
+    // A pitch of size or more has only one cell
+    for (int candidate = max_length; candidate < size; ++candidate) {
+        int max_border = std::min(candidate - 1, first_begin);
+        cuts.assign(max_border + 2, 0);
+
+        // A run is cut by the borders at begin + 1 .. end - 1, modulo the
+        // pitch. It's shorter than the pitch, so that wraps around once
+        // at most.
+        for (const Run& run : runs) {
+            int start = (run.begin + 1) % candidate;
+            int end = start + run.end - run.begin - 1;
+            add_range(cuts, start, std::min(end, candidate));
+            if (end > candidate) {
+                add_range(cuts, 0, end - candidate);
+            }
+        }
+        for (int border = 1; border <= max_border; ++border) {
+            cuts[border] += cuts[border - 1];
+        }
+
+        // All borders between two cut ones give the same cells
+        for (int border = 0; border <= max_border; ++border) {
+            if (cuts[border] != 0 || (border > 0 && cuts[border - 1] == 0)) {
+                continue;
+            }
+            // The space after the last cell doesn't matter, atlases are
+            // often rounded up to a power of two. Sprites in only one cell
+            // don't show a grid though, and neither do cells without empty
+            // space between them. Those are found in any sheet by chance.
+            int candidate_offset, candidate_cell_size;
+            int num_used = shrink_cells(runs, candidate, border,
+                                        candidate_offset, candidate_cell_size);
+            bool is_grid = num_used >= 2 && candidate_cell_size < candidate;
+
+            // Many pitches fit, e.g. every multiple of the real one. The
+            // real one lines up the sprites best, which gives the smallest
+            // cells. Pitches that don't are only found by chance and leave
+            // the sprites at different places in their cells.
+            if (is_grid && candidate_cell_size < cell_size) {
+                pitch = candidate;
+                offset = candidate_offset;
+                cell_size = candidate_cell_size;
+            }
+        }
+        // No cell can be smaller than the longest run
+        if (cell_size == max_length) {
+            break;
+        }
+    }
+
+    return cell_size != INT_MAX;
+}
+
+Grid detect(const Uint8* pixels, int row_pitch, glm::ivec2 dimensions) {
+    std::vector<Uint8> columns(dimensions.x);
+    std::vector<Uint8> rows(dimensions.y);
+    PixelConvert::scan_alpha(pixels, row_pitch, dimensions.x, dimensions.y,
+                             columns.data(), rows.data());
+
+    Grid grid;
+    grid.found = detect_axis(columns.data(), dimensions.x, grid.pitch.x,
+                             grid.offset.x, grid.cell_size.x) &&
+                 detect_axis(rows.data(), dimensions.y, grid.pitch.y,
+                             grid.offset.y, grid.cell_size.y);
+    grid.padding = grid.pitch - grid.cell_size;
+    return grid;
+}
+} // namespace GridDetect
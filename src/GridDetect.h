@@ -0,0 +1,43 @@
+#pragma once
+#include "pch.h"
+
+// Finds the grid the sprites of a sheet are laid out in from the
+// transparent gutters between them. The alpha of every column and row is
+// scanned once (see PixelConvert::scan_alpha), everything after that only
+// looks at which columns and rows are empty, for each axis on its own.
+//
+// A pitch is tried if its cell borders don't cut through any sprite and
+// there are sprites in more than one of its cells. Space after the last cell
+// is left unused. The cells are shrunk to the smallest box that holds the
+// sprite of every cell, and the pitch with the smallest cells wins.
+namespace GridDetect {
+struct Grid {
+    bool found = false;
+    // Distance between the starts of neighbouring cells
+    glm::ivec2 pitch = {0, 0};
+    glm::ivec2 cell_size = {0, 0};
+    // Start of the first cell
+    glm::ivec2 offset = {0, 0};
+    // Empty space between two cells, pitch - cell_size
+    glm::ivec2 padding = {0, 0};
+
+    // Sprites are indexed in cells of sprite_dimensions from the top left
+    // corner. If every cell of the grid is inside of one of those for
+    // sprite_dimensions == pitch, the pitch can be used as they are.
+    bool fits_sprite_dimensions() const {
+        return found && offset.x + cell_size.x <= pitch.x &&
+               offset.y + cell_size.y <= pitch.y;
+    }
+};
+
+// Looks at packed RGBA8 pixels with rows that are row_pitch bytes apart.
+// found is false if there is no grid on either axis, e.g. if the sprites
+// touch or every pixel is transparent.
+Grid detect(const Uint8* pixels, int row_pitch, glm::ivec2 dimensions);
+
+// The part after the scan for one axis. occupied[i] is nonzero if column or
+// row i has a pixel that isn't transparent. Returns false if no pitch is
+// found.
+bool detect_axis(const Uint8* occupied, int size, int& pitch, int& offset,
+                 int& cell_size);
+} // namespace GridDetect
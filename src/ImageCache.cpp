@@ -0,0 +1,255 @@
+#pragma once
+#include "pch.h"
+#include "ImageCache.h"
+#include "MappedFile.h"
+#include "Texture.h"
+
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace ImageCache {
+// Written in front of the pixels. 32 bytes, so the pixels are aligned.
+struct FileHeader {
+    char magic[4];
+    glm::u32 version;
+    glm::u64 key;
+    glm::u32 width;
+    glm::u32 height;
+    // Pixels of one setting of PREMULTIPLIED_ALPHA are useless for the other
+    glm::u32 premultiplied;
+    glm::u32 padding;
+};
+static_assert(sizeof(FileHeader) == 32, "The pixels have to stay aligned");
+
+static const char MAGIC[4] = {'S', 'A', 'I', 'C'};
+static const glm::u32 VERSION = 1;
+static const char* EXTENSION = ".rgba";
+
+static fs::path cache_directory;
+static glm::u64 cache_max_size = 0;
+// Writing and evicting can't run at the same time
+static std::mutex store_mutex;
+
+void init(const char* directory, glm::u64 max_size) {
+    cache_directory = directory;
+    cache_max_size = max_size;
+}
+
+bool is_enabled() { return !cache_directory.empty(); }
+
+static fs::path get_path(const Key& key) {
+    char name[32];
+    sprintf_s(name, "%016llx%s", static_cast<unsigned long long>(key.hash),
+              EXTENSION);
+    return cache_directory / name;
+}
+
+// Last step of xxHash64, spreads every input bit over the whole hash
+static glm::u64 mix(glm::u64 hash) {
+    hash ^= hash >> 33;
+    hash *= 0xc2b2ae3d27d4eb4full;
+    hash ^= hash >> 29;
+    hash *= 0x165667b19e3779f9ull;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Four independent lanes of multiplies and rotations like xxHash64, which
+// runs at several GB/s. Hashing a sheet takes a fraction of decoding it.
+static glm::u64 hash_bytes(const Uint8* data, size_t size) {
+    const glm::u64 PRIME_1 = 0x9e3779b185ebca87ull;
+    const glm::u64 PRIME_2 = 0xc2b2ae3d27d4eb4full;
+
+    glm::u64 lanes[4] = {PRIME_1 + PRIME_2, PRIME_2, 0, 0 - PRIME_1};
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int lane = 0; lane < 4; ++lane) {
+            glm::u64 word;
+            memcpy(&word, data + i + lane * 8, 8);
+            glm::u64 value = lanes[lane] + word * PRIME_2;
+            lanes[lane] = ((value << 31) | (value >> 33)) * PRIME_1;
+        }
+    }
+
+    glm::u64 hash = size;
+    for (int lane = 0; lane < 4; ++lane) {
+        hash = (hash ^ mix(lanes[lane])) * PRIME_1;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ data[i]) * PRIME_1;
+    }
+    return mix(hash);
+}
+
+bool get_key(const char* image_path, Key& key) {
+    if (!is_enabled()) {
+        return false;
+    }
+
+    std::error_code error;
+    auto modified = fs::last_write_time(image_path, error);
+    if (error) {
+        return false;
+    }
+
+    MappedFile file;
+    if (!file.open(image_path)) {
+        return false;
+    }
+
+    glm::u64 hash = hash_bytes(reinterpret_cast<const Uint8*>(file.data()),
+                               file.size());
+    key.hash = mix(hash ^ static_cast<glm::u64>(
+                              modified.time_since_epoch().count()));
+    return true;
+}
+
+bool find(const Key& key, MappedFile& file, glm::ivec2& dimensions,
+          const Uint8*& pixels) {
+    if (!is_enabled()) {
+        return false;
+    }
+
+    // The modification time is the time of the last use, which is what the
+    // eviction goes by. It can't be changed while the file is mapped.
+    fs::path path = get_path(key);
+    std::error_code error;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+    if (error || !file.open(path.string().c_str())) {
+        return false;
+    }
+
+    FileHeader header;
+    if (file.size() < sizeof(header)) {
+        file.close();
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+
+    size_t pixels_size = static_cast<size_t>(header.width) * header.height * 4;
+    if (memcmp(header.magic, MAGIC, 4) != 0 || header.version != VERSION ||
+        header.key != key.hash ||
+        header.premultiplied != static_cast<glm::u32>(PREMULTIPLIED_ALPHA) ||
+        file.size() != sizeof(header) + pixels_size) {
+        file.close();
+        return false;
+    }
+
+    dimensions = {static_cast<int>(header.width),
+                  static_cast<int>(header.height)};
+    pixels = reinterpret_cast<const Uint8*>(file.data()) + sizeof(header);
+    return true;
+}
+
+static void evict(glm::u64 max_size) {
+    struct CachedFile {
+        fs::path path;
+        glm::u64 size;
+        fs::file_time_type last_used;
+    };
+    std::vector<CachedFile> files;
+    glm::u64 total_size = 0;
+
+    std::error_code error;
+    for (const auto& item : fs::directory_iterator(cache_directory, error)) {
+        if (item.path().extension() != EXTENSION) {
+            continue;
+        }
+        std::error_code size_error, time_error;
+        CachedFile file = {item.path(), item.file_size(size_error),
+                           item.last_write_time(time_error)};
+        if (!size_error && !time_error) {
+            files.push_back(file);
+            total_size += file.size;
+        }
+    }
+    if (total_size <= max_size) {
+        return;
+    }
+
+    std::sort(files.begin(), files.end(),
+              [](const CachedFile& lhs, const CachedFile& rhs) {
+                  return lhs.last_used < rhs.last_used;
+              });
+    for (const auto& file : files) {
+        if (total_size <= max_size) {
+            break;
+        }
+        if (fs::remove(file.path, error)) {
+            total_size -= file.size;
+        }
+    }
+}
+
+void store(const Key& key, glm::ivec2 dimensions, const Uint8* pixels) {
+    size_t row_size = static_cast<size_t>(dimensions.x) * 4;
+    store_rows(key, dimensions, [=](int first_row, int num_rows, Uint8* dst) {
+        memcpy(dst, pixels + first_row * row_size, num_rows * row_size);
+    });
+}
+
+bool store_rows(const Key& key, glm::ivec2 dimensions,
+                const std::function<void(int, int, Uint8*)>& convert_rows) {
+    // About this much is converted and written at once
+    const size_t CHUNK_SIZE = 4 * 1024 * 1024;
+
+    if (!is_enabled()) {
+        return false;
+    }
+
+    FileHeader header = {};
+    memcpy(header.magic, MAGIC, 4);
+    header.version = VERSION;
+    header.key = key.hash;
+    header.width = static_cast<glm::u32>(dimensions.x);
+    header.height = static_cast<glm::u32>(dimensions.y);
+    header.premultiplied = static_cast<glm::u32>(PREMULTIPLIED_ALPHA);
+    size_t pixels_size = static_cast<size_t>(dimensions.x) * dimensions.y * 4;
+
+    // It would only evict every other image and then itself
+    if (sizeof(header) + pixels_size > cache_max_size) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(store_mutex);
+
+    // Written under another name first, so a file that was cut short is
+    // never found
+    fs::path path = get_path(key);
+    fs::path temp_path = path;
+    temp_path += ".tmp";
+
+    SDL_RWops* file_ptr = SDL_RWFromFile(temp_path.string().c_str(), "wb");
+    if (!file_ptr) {
+        return false;
+    }
+    bool success = SDL_RWwrite(file_ptr, &header, sizeof(header), 1) == 1;
+
+    size_t row_size = static_cast<size_t>(dimensions.x) * 4;
+    int rows_per_chunk =
+        static_cast<int>(std::max<size_t>(CHUNK_SIZE / row_size, 1));
+    std::vector<Uint8> chunk(
+        row_size * std::min(rows_per_chunk, dimensions.y));
+    for (int row = 0; success && row < dimensions.y; row += rows_per_chunk) {
+        int num_rows = std::min(rows_per_chunk, dimensions.y - row);
+        size_t chunk_size = num_rows * row_size;
+        convert_rows(row, num_rows, chunk.data());
+        success = SDL_RWwrite(file_ptr, chunk.data(), 1, chunk_size) ==
+                  chunk_size;
+    }
+    success = SDL_RWclose(file_ptr) == 0 && success;
+
+    std::error_code error;
+    if (success) {
+        fs::rename(temp_path, path, error);
+    }
+    if (!success || error) {
+        fs::remove(temp_path, error);
+        return false;
+    }
+
+    evict(cache_max_size);
+    return true;
+}
+} // namespace ImageCache
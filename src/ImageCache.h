@@ -0,0 +1,48 @@
+#pragma once
+#include "pch.h"
+
+class MappedFile;
+
+// Directory of images that were already decoded and converted to the format
+// the textures store, so opening the same sheet again maps the pixels
+// instead of decoding them. A file is found by a hash of its content, size
+// and modification time, so changing the image makes it miss.
+// When the files take up more than the maximum size, the ones that were used
+// least recently are deleted.
+//
+// The cache does nothing until init() is called. Everything else can be
+// called from any thread.
+namespace ImageCache {
+// Enough for one 16k x 16k sheet with room to spare
+const glm::u64 DEFAULT_MAX_SIZE = 2048ull * 1024 * 1024;
+
+struct Key {
+    glm::u64 hash = 0;
+};
+
+// The directory has to exist
+void init(const char* directory, glm::u64 max_size = DEFAULT_MAX_SIZE);
+bool is_enabled();
+
+// Reads the whole image file. Returns false if it doesn't exist or the
+// cache is disabled.
+bool get_key(const char* image_path, Key& key);
+
+// Maps the cached pixels into file on a hit. pixels then points to packed
+// RGBA8 in the mapped file and stays valid while it's open.
+bool find(const Key& key, MappedFile& file, glm::ivec2& dimensions,
+          const Uint8*& pixels);
+
+// Writes the packed RGBA8 pixels of the image with the given key and evicts
+// old images if the cache got too big. Images bigger than the whole cache
+// are skipped. Failing to write is not an error, the image is just decoded
+// again next time.
+void store(const Key& key, glm::ivec2 dimensions, const Uint8* pixels);
+// Same, but the pixels are made a few rows at a time while they're written.
+// convert_rows(first_row, num_rows, dst) fills dst with num_rows packed rows,
+// so the whole image never has to be in memory in the cache's format.
+// Returns true if the image was stored.
+bool store_rows(
+    const Key& key, glm::ivec2 dimensions,
+    const std::function<void(int, int, Uint8*)>& convert_rows);
+} // namespace ImageCache
@@ -0,0 +1,56 @@
+#pragma once
+#include "pch.h"
+#include "MappedFile.h"
+
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::open(const char* path) {
+    close();
+
+    file_handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    // Empty files can't be mapped
+    if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0) {
+        close();
+        return false;
+    }
+
+    mapping_handle =
+        CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_handle == NULL) {
+        close();
+        return false;
+    }
+
+    view = static_cast<const char*>(
+        MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    if (view == nullptr) {
+        close();
+        return false;
+    }
+    view_size = static_cast<size_t>(file_size.QuadPart);
+
+    return true;
+}
+
+void MappedFile::close() {
+    if (view) {
+        UnmapViewOfFile(view);
+        view = nullptr;
+    }
+    view_size = 0;
+
+    if (mapping_handle != NULL) {
+        CloseHandle(mapping_handle);
+        mapping_handle = NULL;
+    }
+    if (file_handle != INVALID_HANDLE_VALUE) {
+        CloseHandle(file_handle);
+        file_handle = INVALID_HANDLE_VALUE;
+    }
+}
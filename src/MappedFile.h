@@ -0,0 +1,27 @@
+#pragma once
+#include "pch.h"
+
+// Read-only view of a whole file that is mapped into the address space of the
+// process. The data stays valid until the file is closed or the MappedFile is
+// destroyed.
+class MappedFile {
+    HANDLE file_handle = INVALID_HANDLE_VALUE;
+    HANDLE mapping_handle = NULL;
+    const char* view = nullptr;
+    size_t view_size = 0;
+
+  public:
+    MappedFile() {}
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Returns false if the file doesn't exist, is empty or can't be mapped.
+    bool open(const char* path);
+    void close();
+
+    bool is_open() const { return view != nullptr; }
+    const char* data() const { return view; }
+    size_t size() const { return view_size; }
+};
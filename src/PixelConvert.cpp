@@ -0,0 +1,435 @@
+#pragma once
+#include "pch.h"
+#include "PixelConvert.h"
+
+#include <immintrin.h>
+#include <intrin.h>
+
+// MSVC compiles any intrinsic, GCC and Clang only in functions that are
+// compiled for an instruction set that has it
+#ifdef _MSC_VER
+#define TARGET(isa)
+#else
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace PixelConvert {
+
+// Where the color channels are in a source pixel. A 4 byte pixel has its
+// alpha in the last byte.
+struct Layout {
+    int bytes_per_pixel;
+    int red, green, blue;
+};
+
+static const Layout LAYOUTS[] = {
+    {4, 0, 1, 2}, // RGBA
+    {4, 2, 1, 0}, // BGRA
+    {3, 0, 1, 2}, // RGB
+    {3, 2, 1, 0}, // BGR
+};
+
+using ShuffleRow = void (*)(const Uint8* src, Uint8* dst, size_t num_pixels,
+                            const Layout& layout);
+using PremultiplyRow = void (*)(Uint8* pixels, size_t num_pixels);
+// ORs every pixel of a row into its column and returns the OR of the row.
+// The alpha ends up in the top byte.
+using ScanAlphaRow = Uint32 (*)(const Uint8* pixels, Uint32* columns,
+                                size_t num_pixels);
+
+// c * a / 255, rounded. Exact for all inputs and cheap in 16 bit lanes.
+static inline Uint8 multiply_alpha(unsigned c, unsigned a) {
+    unsigned t = c * a + 128;
+    return static_cast<Uint8>((t + (t >> 8)) >> 8);
+}
+
+static void shuffle_scalar(const Uint8* src, Uint8* dst, size_t num_pixels,
+                           const Layout& layout) {
+    int bpp = layout.bytes_per_pixel;
+    for (size_t i = 0; i < num_pixels; ++i) {
+        const Uint8* in = src + i * bpp;
+        Uint8* out = dst + i * 4;
+        Uint8 r = in[layout.red], g = in[layout.green], b = in[layout.blue];
+        Uint8 a = bpp == 4 ? in[3] : 255;
+        out[0] = r;
+        out[1] = g;
+        out[2] = b;
+        out[3] = a;
+    }
+}
+
+static void premultiply_scalar(Uint8* pixels, size_t num_pixels) {
+    for (size_t i = 0; i < num_pixels; ++i) {
+        Uint8* pixel = pixels + i * 4;
+        unsigned a = pixel[3];
+        pixel[0] = multiply_alpha(pixel[0], a);
+        pixel[1] = multiply_alpha(pixel[1], a);
+        pixel[2] = multiply_alpha(pixel[2], a);
+    }
+}
+
+// SSE2 has no byte shuffle, it only swaps red and blue of 4 byte pixels
+static void shuffle_sse2(const Uint8* src, Uint8* dst, size_t num_pixels,
+                         const Layout& layout) {
+    if (layout.bytes_per_pixel != 4 || layout.red != 2) {
+        shuffle_scalar(src, dst, num_pixels, layout);
+        return;
+    }
+
+    const __m128i red_blue = _mm_set1_epi32(0x00ff00ff);
+    size_t i = 0;
+    for (; i + 4 <= num_pixels; i += 4) {
+        __m128i pixels =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        __m128i rb = _mm_and_si128(pixels, red_blue);
+        __m128i ga = _mm_andnot_si128(red_blue, pixels);
+        rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4),
+                         _mm_or_si128(rb, ga));
+    }
+    shuffle_scalar(src + i * 4, dst + i * 4, num_pixels - i, layout);
+}
+
+// Multiplies the color of two pixels widened to 16 bit lanes by their
+// alpha. The alpha lanes are multiplied by 255, which leaves them as they
+// are.
+static inline __m128i multiply_alpha_sse2(__m128i pixels) {
+    const __m128i alpha_lanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    const __m128i alpha_255 = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+
+    __m128i alpha = _mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm_or_si128(_mm_andnot_si128(alpha_lanes, alpha), alpha_255);
+
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(pixels, alpha),
+                              _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+static void premultiply_sse2(Uint8* pixels, size_t num_pixels) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= num_pixels; i += 4) {
+        __m128i* p = reinterpret_cast<__m128i*>(pixels + i * 4);
+        __m128i four = _mm_loadu_si128(p);
+        __m128i lo = multiply_alpha_sse2(_mm_unpacklo_epi8(four, zero));
+        __m128i hi = multiply_alpha_sse2(_mm_unpackhi_epi8(four, zero));
+        _mm_storeu_si128(p, _mm_packus_epi16(lo, hi));
+    }
+    premultiply_scalar(pixels + i * 4, num_pixels - i);
+}
+
+// Shuffle mask that turns 4 source pixels into 4 RGBA pixels. Bytes with
+// the top bit set become 0, the alpha of 3 byte pixels is or'ed in after.
+static void make_shuffle_mask(const Layout& layout, char mask[16]) {
+    for (int p = 0; p < 4; ++p) {
+        int first = p * layout.bytes_per_pixel;
+        mask[p * 4 + 0] = static_cast<char>(first + layout.red);
+        mask[p * 4 + 1] = static_cast<char>(first + layout.green);
+        mask[p * 4 + 2] = static_cast<char>(first + layout.blue);
+        mask[p * 4 + 3] =
+            layout.bytes_per_pixel == 4 ? static_cast<char>(first + 3) : -128;
+    }
+}
+
+TARGET("ssse3")
+static void shuffle_ssse3(const Uint8* src, Uint8* dst, size_t num_pixels,
+                          const Layout& layout) {
+    char mask_bytes[16];
+    make_shuffle_mask(layout, mask_bytes);
+    const __m128i mask =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask_bytes));
+    const __m128i alpha = layout.bytes_per_pixel == 4
+                              ? _mm_setzero_si128()
+                              : _mm_set1_epi32(static_cast<int>(0xff000000));
+
+    // Every load reads 16 bytes, with 3 byte pixels that is more than the 4
+    // pixels that are used, which mustn't go past the end of the row
+    size_t bpp = layout.bytes_per_pixel;
+    size_t i = 0;
+    for (; (i * bpp + 16) <= num_pixels * bpp; i += 4) {
+        __m128i pixels =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * bpp));
+        pixels = _mm_or_si128(_mm_shuffle_epi8(pixels, mask), alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), pixels);
+    }
+    shuffle_scalar(src + i * bpp, dst + i * 4, num_pixels - i, layout);
+}
+
+TARGET("avx2")
+static void shuffle_avx2(const Uint8* src, Uint8* dst, size_t num_pixels,
+                         const Layout& layout) {
+    char mask_bytes[16];
+    make_shuffle_mask(layout, mask_bytes);
+    // The shuffle can't cross the 128 bit lanes, so each lane gets 4 pixels
+    const __m256i mask = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask_bytes)));
+    const __m256i alpha = layout.bytes_per_pixel == 4
+                              ? _mm256_setzero_si256()
+                              : _mm256_set1_epi32(static_cast<int>(0xff000000));
+
+    size_t bpp = layout.bytes_per_pixel;
+    size_t i = 0;
+    for (; (i * bpp + 4 * bpp + 16) <= num_pixels * bpp; i += 8) {
+        const Uint8* in = src + i * bpp;
+        __m256i pixels = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(in))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 4 * bpp)),
+            1);
+        pixels = _mm256_or_si256(_mm256_shuffle_epi8(pixels, mask), alpha);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), pixels);
+    }
+    shuffle_scalar(src + i * bpp, dst + i * 4, num_pixels - i, layout);
+}
+
+// Same as multiply_alpha_sse2() for 4 pixels
+TARGET("avx2")
+static inline __m256i multiply_alpha_avx2(__m256i pixels) {
+    const __m256i alpha_lanes = _mm256_set_epi16(
+        -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+    const __m256i alpha_255 = _mm256_set_epi16(
+        255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+
+    __m256i alpha = _mm256_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm256_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha =
+        _mm256_or_si256(_mm256_andnot_si256(alpha_lanes, alpha), alpha_255);
+
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(pixels, alpha),
+                                 _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+TARGET("avx2")
+static void premultiply_avx2(Uint8* pixels, size_t num_pixels) {
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= num_pixels; i += 8) {
+        __m256i* p = reinterpret_cast<__m256i*>(pixels + i * 4);
+        __m256i eight = _mm256_loadu_si256(p);
+        // Unpacking and packing both work within the 128 bit lanes, so the
+        // pixels end up where they were
+        __m256i lo = multiply_alpha_avx2(_mm256_unpacklo_epi8(eight, zero));
+        __m256i hi = multiply_alpha_avx2(_mm256_unpackhi_epi8(eight, zero));
+        _mm256_storeu_si256(p, _mm256_packus_epi16(lo, hi));
+    }
+    premultiply_sse2(pixels + i * 4, num_pixels - i);
+}
+
+static Uint32 scan_alpha_scalar(const Uint8* pixels, Uint32* columns,
+                                size_t num_pixels) {
+    Uint32 row = 0;
+    for (size_t i = 0; i < num_pixels; ++i) {
+        Uint32 pixel;
+        memcpy(&pixel, pixels + i * 4, 4);
+        columns[i] |= pixel;
+        row |= pixel;
+    }
+    return row;
+}
+
+// Only ORs, the colors don't have to be masked out until the end
+static Uint32 scan_alpha_sse2(const Uint8* pixels, Uint32* columns,
+                              size_t num_pixels) {
+    __m128i row = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= num_pixels; i += 4) {
+        __m128i four =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i * 4));
+        __m128i* column = reinterpret_cast<__m128i*>(columns + i);
+        _mm_storeu_si128(column, _mm_or_si128(_mm_loadu_si128(column), four));
+        row = _mm_or_si128(row, four);
+    }
+    row = _mm_or_si128(row, _mm_shuffle_epi32(row, _MM_SHUFFLE(1, 0, 3, 2)));
+    row = _mm_or_si128(row, _mm_shuffle_epi32(row, _MM_SHUFFLE(2, 3, 0, 1)));
+    return static_cast<Uint32>(_mm_cvtsi128_si32(row)) |
+           scan_alpha_scalar(pixels + i * 4, columns + i, num_pixels - i);
+}
+
+TARGET("avx2")
+static Uint32 scan_alpha_avx2(const Uint8* pixels, Uint32* columns,
+                              size_t num_pixels) {
+    __m256i row = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= num_pixels; i += 8) {
+        __m256i eight = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(pixels + i * 4));
+        __m256i* column = reinterpret_cast<__m256i*>(columns + i);
+        _mm256_storeu_si256(column,
+                            _mm256_or_si256(_mm256_loadu_si256(column), eight));
+        row = _mm256_or_si256(row, eight);
+    }
+    __m128i half = _mm_or_si128(_mm256_castsi256_si128(row),
+                                _mm256_extracti128_si256(row, 1));
+    half = _mm_or_si128(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_or_si128(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    return static_cast<Uint32>(_mm_cvtsi128_si32(half)) |
+           scan_alpha_sse2(pixels + i * 4, columns + i, num_pixels - i);
+}
+
+static const ShuffleRow SHUFFLE_ROWS[] = {shuffle_scalar, shuffle_sse2,
+                                          shuffle_ssse3, shuffle_avx2};
+// SSSE3 adds nothing that helps with the multiplication
+static const PremultiplyRow PREMULTIPLY_ROWS[] = {
+    premultiply_scalar, premultiply_sse2, premultiply_sse2, premultiply_avx2};
+static const ScanAlphaRow SCAN_ALPHA_ROWS[] = {
+    scan_alpha_scalar, scan_alpha_sse2, scan_alpha_sse2, scan_alpha_avx2};
+
+static Kernel detect_best_kernel() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    bool ssse3 = (info[2] & (1 << 9)) != 0;
+    // The OS also has to save the AVX registers
+    bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+               (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    bool avx2 = avx && (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    bool ssse3 = __builtin_cpu_supports("ssse3");
+    bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+    if (avx2) {
+        return Kernel::AVX2;
+    }
+    // SSE2 is part of x64
+    return ssse3 ? Kernel::SSSE3 : Kernel::SSE2;
+}
+
+const char* get_format_name(Format format) {
+    static const char* NAMES[] = {"RGBA", "BGRA", "RGB", "BGR"};
+    return NAMES[static_cast<int>(format)];
+}
+
+const char* get_kernel_name(Kernel kernel) {
+    static const char* NAMES[] = {"scalar", "SSE2", "SSSE3", "AVX2"};
+    return NAMES[static_cast<int>(kernel)];
+}
+
+int get_bytes_per_pixel(Format format) {
+    return LAYOUTS[static_cast<int>(format)].bytes_per_pixel;
+}
+
+Kernel get_best_kernel() {
+    static const Kernel best = detect_best_kernel();
+    return best;
+}
+
+bool is_supported(Kernel kernel) {
+    return static_cast<int>(kernel) <= static_cast<int>(get_best_kernel());
+}
+
+void convert(const Uint8* src, int src_pitch, Format format, Uint8* dst,
+             int width, int height, bool premultiply, Kernel kernel) {
+    SDL_assert(is_supported(kernel));
+
+    const Layout& layout = LAYOUTS[static_cast<int>(format)];
+    ShuffleRow shuffle_row = SHUFFLE_ROWS[static_cast<int>(kernel)];
+    PremultiplyRow premultiply_row = PREMULTIPLY_ROWS[static_cast<int>(kernel)];
+    size_t row_size = static_cast<size_t>(width) * 4;
+
+    // A row at a time, so premultiplying reads what was just written while
+    // it's still in the cache
+    for (int y = 0; y < height; ++y) {
+        const Uint8* src_row = src + static_cast<size_t>(y) * src_pitch;
+        Uint8* dst_row = dst + y * row_size;
+
+        if (format != Format::RGBA) {
+            shuffle_row(src_row, dst_row, width, layout);
+        } else if (src_row != dst_row) {
+            memcpy(dst_row, src_row, row_size);
+        }
+        if (premultiply) {
+            premultiply_row(dst_row, width);
+        }
+    }
+}
+
+void scan_alpha(const Uint8* pixels, int pitch, int width, int height,
+                Uint8* column_alpha, Uint8* row_alpha, Kernel kernel) {
+    SDL_assert(is_supported(kernel));
+
+    ScanAlphaRow scan_row = SCAN_ALPHA_ROWS[static_cast<int>(kernel)];
+    // Whole pixels, so the columns can be ORed without shuffling
+    std::vector<Uint32> columns(width, 0);
+
+    for (int y = 0; y < height; ++y) {
+        Uint32 row = scan_row(pixels + static_cast<size_t>(y) * pitch,
+                              columns.data(), width);
+        row_alpha[y] = static_cast<Uint8>(row >> 24);
+    }
+    for (int x = 0; x < width; ++x) {
+        column_alpha[x] = static_cast<Uint8>(columns[x] >> 24);
+    }
+}
+
+// The format the kernels read the surface as. Returns false if SDL has to
+// convert it first.
+static bool get_surface_format(SDL_Surface* surface, Format& format) {
+    // A color key, e.g. from the tRNS chunk of an RGB png, only becomes
+    // transparency when SDL converts the surface
+    Uint32 color_key;
+    if (SDL_GetColorKey(surface, &color_key) == 0) {
+        return false;
+    }
+
+    switch (surface->format->format) {
+    case SDL_PIXELFORMAT_RGBA32:
+        format = Format::RGBA;
+        return true;
+    case SDL_PIXELFORMAT_BGRA32:
+        format = Format::BGRA;
+        return true;
+    case SDL_PIXELFORMAT_RGB24:
+        format = Format::RGB;
+        return true;
+    case SDL_PIXELFORMAT_BGR24:
+        format = Format::BGR;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool can_convert_rows(SDL_Surface* surface) {
+    Format format;
+    return get_surface_format(surface, format);
+}
+
+void convert_rows(SDL_Surface* surface, int first_row, int num_rows,
+                  Uint8* dst, bool premultiply) {
+    SDL_assert(first_row >= 0 && num_rows >= 0 &&
+               first_row + num_rows <= surface->h);
+
+    Format format;
+    if (!get_surface_format(surface, format)) {
+        SDL_assert(false);
+        return;
+    }
+
+    const Uint8* src = static_cast<const Uint8*>(surface->pixels) +
+                       static_cast<size_t>(first_row) * surface->pitch;
+    convert(src, surface->pitch, format, dst, surface->w, num_rows,
+            premultiply);
+}
+
+bool convert_surface(SDL_Surface* surface, Uint8* dst, bool premultiply) {
+    if (can_convert_rows(surface)) {
+        convert_rows(surface, 0, surface->h, dst, premultiply);
+        return true;
+    }
+
+    SDL_Surface* converted =
+        SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+    if (!converted) {
+        return false;
+    }
+    convert(static_cast<const Uint8*>(converted->pixels), converted->pitch,
+            Format::RGBA, dst, converted->w, converted->h, premultiply);
+    SDL_FreeSurface(converted);
+    return true;
+}
+} // namespace PixelConvert
@@ -0,0 +1,51 @@
+#pragma once
+#include "pch.h"
+
+// Turns decoded images into tightly packed RGBA8, the only format textures
+// are uploaded as. The formats image loaders usually return are converted
+// row by row with SIMD kernels, picked by what the CPU supports. Everything
+// else (paletted, 16 bit, ...) goes through SDL_ConvertSurfaceFormat first.
+// The alpha scan of GridDetect runs on the same kernels.
+namespace PixelConvert {
+// Byte order of the source pixels. The 3 byte formats get an opaque alpha.
+enum class Format { RGBA, BGRA, RGB, BGR, COUNT };
+enum class Kernel { SCALAR, SSE2, SSSE3, AVX2, COUNT };
+
+const char* get_format_name(Format format);
+const char* get_kernel_name(Kernel kernel);
+int get_bytes_per_pixel(Format format);
+
+bool is_supported(Kernel kernel);
+// The fastest kernel the CPU supports, checked once
+Kernel get_best_kernel();
+
+// Converts width * height pixels. The rows of src are src_pitch bytes apart,
+// the ones of dst are packed. For RGBA, dst can be src if there is no
+// padding between the rows.
+// premultiply multiplies the color by the alpha, rounded to the nearest
+// value. Every kernel gives exactly the same result.
+void convert(const Uint8* src, int src_pitch, Format format, Uint8* dst,
+             int width, int height, bool premultiply,
+             Kernel kernel = get_best_kernel());
+
+// Same for any surface, dst has to hold w * h * 4 bytes and can be the
+// pixels of a packed RGBA32 surface. Returns false if SDL can't convert the
+// format of the surface.
+bool convert_surface(SDL_Surface* surface, Uint8* dst, bool premultiply);
+
+// True if the kernels read the surface directly, without converting all of
+// it with SDL first. Only those can be converted a few rows at a time.
+bool can_convert_rows(SDL_Surface* surface);
+// Converts num_rows rows of the surface, starting at first_row, into dst,
+// which has to hold w * num_rows * 4 bytes. See can_convert_rows().
+void convert_rows(SDL_Surface* surface, int first_row, int num_rows,
+                  Uint8* dst, bool premultiply);
+
+// Finds the columns and rows of packed RGBA8 pixels that aren't completely
+// transparent. column_alpha gets width bytes, each the OR of the alphas in
+// a column, row_alpha the same for the height rows. The rows of pixels are
+// pitch bytes apart.
+void scan_alpha(const Uint8* pixels, int pitch, int width, int height,
+                Uint8* column_alpha, Uint8* row_alpha,
+                Kernel kernel = get_best_kernel());
+} // namespace PixelConvert
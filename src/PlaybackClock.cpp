@@ -0,0 +1,60 @@
+#pragma once
+#include "pch.h"
+#include "PlaybackClock.h"
+
+Ticks frames_to_ticks(float frames) {
+    double ticks = std::round(static_cast<double>(frames) * TICKS_PER_FRAME);
+    return static_cast<Ticks>(std::clamp(ticks, 0.0, double(MAX_TICKS)));
+}
+
+float ticks_to_frames(Ticks ticks) {
+    return static_cast<float>(ticks) / static_cast<float>(TICKS_PER_FRAME);
+}
+
+int ticks_to_ms(Ticks ticks) {
+    return static_cast<int>(
+        (static_cast<glm::u64>(ticks) * 1000 + TICKS_PER_SECOND - 1) /
+        TICKS_PER_SECOND);
+}
+
+void PlaybackClock::start() {
+    frequency = SDL_GetPerformanceFrequency();
+    last_counter = SDL_GetPerformanceCounter();
+    remainder = 0;
+}
+
+Ticks PlaybackClock::tick() {
+    glm::u64 counter = SDL_GetPerformanceCounter();
+    glm::u64 elapsed = counter - last_counter;
+    last_counter = counter;
+
+    Ticks limit = max_delta;
+    max_delta = MAX_DELTA_TICKS;
+
+    // Long pauses are clamped, which also keeps them from overflowing below
+    glm::u64 max_elapsed = frequency * limit / TICKS_PER_SECOND;
+    if (elapsed >= max_elapsed) {
+        remainder = 0;
+        return limit;
+    }
+
+    glm::u64 scaled = elapsed * TICKS_PER_SECOND + remainder;
+    remainder = scaled % frequency;
+    return static_cast<Ticks>(scaled / frequency);
+}
+
+void PlaybackClock::expect_wait(int timeout_ms) {
+    Ticks max_wait = MAX_TICKS - MAX_DELTA_TICKS;
+    Ticks wait = max_wait;
+    if (timeout_ms >= 0) {
+        wait = static_cast<Ticks>(
+            std::min<glm::u64>(static_cast<glm::u64>(timeout_ms) *
+                                   TICKS_PER_SECOND / 1000,
+                               max_wait));
+    }
+    max_delta = wait + MAX_DELTA_TICKS;
+}
+
+void PlaybackClock::skip() {
+    last_counter = SDL_GetPerformanceCounter();
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "pch.h"
+
+// Playback time is counted in integer ticks instead of float frames, so it
+// adds up exactly and plays back the same on every run and every machine.
+// Step durations are still stored in frames of a 60 Hz display.
+using Ticks = glm::u32;
+
+const Ticks TICKS_PER_FRAME = 1000;
+const Ticks FRAMES_PER_SECOND = 60;
+const Ticks TICKS_PER_SECOND = TICKS_PER_FRAME * FRAMES_PER_SECOND;
+// Animations and deltas are clamped to this (about 10 hours), so adding a
+// delta to a time inside of an animation can't overflow
+const Ticks MAX_TICKS = 1u << 31;
+
+// The most tick() returns at once, on top of a wait announced with
+// expect_wait(). Frames that took longer, e.g. while the window is dragged
+// or the process is stopped in a debugger, play back as if only this much
+// time passed, instead of jumping ahead.
+const Ticks MAX_DELTA_TICKS = TICKS_PER_SECOND / 4;
+
+// Rounds to the nearest tick
+Ticks frames_to_ticks(float frames);
+float ticks_to_frames(Ticks ticks);
+// Rounded up, waiting less would wake up before the time has passed
+int ticks_to_ms(Ticks ticks);
+
+// Turns the high resolution performance counter into ticks. The part of the
+// elapsed time that doesn't make up a whole tick is carried over to the next
+// call, so no time is lost to rounding.
+class PlaybackClock {
+    glm::u64 frequency = 1;
+    glm::u64 last_counter = 0;
+    // In counter units times TICKS_PER_SECOND
+    glm::u64 remainder = 0;
+    // Of the next tick()
+    Ticks max_delta = MAX_DELTA_TICKS;
+
+  public:
+    void start();
+    // Returns the ticks since the last call, or since start(), at most
+    // MAX_DELTA_TICKS more than an expected wait
+    Ticks tick();
+    // The next tick() follows a wait of up to timeout_ms, or an unlimited one
+    // if it's negative (like SDL_WaitEventTimeout). That time is played back
+    // as it passed, only a stall beyond it is clamped.
+    void expect_wait(int timeout_ms);
+    // The time since the last tick() is dropped
+    void skip();
+};
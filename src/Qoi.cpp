@@ -0,0 +1,274 @@
+#pragma once
+#include "pch.h"
+#include "Qoi.h"
+#include "MappedFile.h"
+#include "PixelConvert.h"
+
+namespace Qoi {
+// Ops with a 2 bit tag, the other 6 bits are the argument
+const glm::u8 OP_INDEX = 0x00;
+const glm::u8 OP_DIFF = 0x40;
+const glm::u8 OP_LUMA = 0x80;
+const glm::u8 OP_RUN = 0xc0;
+const glm::u8 TAG_MASK = 0xc0;
+// Ops with an 8 bit tag, they take the place of runs of 63 and 64
+const glm::u8 OP_RGB = 0xfe;
+const glm::u8 OP_RGBA = 0xff;
+
+const int MAX_RUN = 62;
+// Seven zeros and a one after the last op
+const glm::u8 END_MARKER[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+struct Pixel {
+    glm::u8 r, g, b, a;
+};
+
+static int get_index(Pixel px) {
+    return (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+}
+
+static bool operator==(Pixel lhs, Pixel rhs) {
+    return lhs.r == rhs.r && lhs.g == rhs.g && lhs.b == rhs.b &&
+           lhs.a == rhs.a;
+}
+
+static glm::u32 read_u32(const Uint8* bytes) {
+    return (static_cast<glm::u32>(bytes[0]) << 24) | (bytes[1] << 16) |
+           (bytes[2] << 8) | bytes[3];
+}
+
+static void write_u32(glm::u32 value, std::vector<Uint8>& out) {
+    out.push_back(static_cast<Uint8>(value >> 24));
+    out.push_back(static_cast<Uint8>(value >> 16));
+    out.push_back(static_cast<Uint8>(value >> 8));
+    out.push_back(static_cast<Uint8>(value));
+}
+
+bool read_header(const Uint8* data, size_t size, Header& header) {
+    if (size < HEADER_SIZE || memcmp(data, "qoif", 4) != 0) {
+        return false;
+    }
+
+    header.width = read_u32(data + 4);
+    header.height = read_u32(data + 8);
+    header.channels = data[12];
+    header.colorspace = data[13];
+
+    return header.width > 0 && header.height > 0 &&
+           header.height < MAX_PIXELS / header.width &&
+           (header.channels == 3 || header.channels == 4) &&
+           header.colorspace <= 1;
+}
+
+bool decode(const Uint8* data, size_t size, Uint8* dst) {
+    Header header;
+    if (!read_header(data, size, header) ||
+        size < HEADER_SIZE + sizeof(END_MARKER)) {
+        return false;
+    }
+
+    // Ops start within the last 8 bytes only in broken files. Stopping
+    // before them means an op can be read without checking its size.
+    const Uint8* p = data + HEADER_SIZE;
+    const Uint8* ops_end = data + size - sizeof(END_MARKER);
+    Uint8* out = dst;
+    Uint8* out_end =
+        dst + static_cast<size_t>(header.width) * header.height * 4;
+
+    Pixel index[64] = {};
+    Pixel px = {0, 0, 0, 255};
+
+    while (out < out_end) {
+        if (p >= ops_end) {
+            return false;
+        }
+
+        // Ordered by how often the ops are in sprite sheets. The 8 bit tags
+        // share their top bits with runs.
+        glm::u8 op = *p++;
+        if ((op & TAG_MASK) == OP_INDEX) {
+            px = index[op];
+            memcpy(out, &px, 4);
+            out += 4;
+            continue;
+        } else if ((op & TAG_MASK) == OP_DIFF) {
+            px.r += ((op >> 4) & 3) - 2;
+            px.g += ((op >> 2) & 3) - 2;
+            px.b += (op & 3) - 2;
+        } else if ((op & TAG_MASK) == OP_LUMA) {
+            int dg = (op & 0x3f) - 32;
+            glm::u8 drb = *p++;
+            px.r += dg - 8 + ((drb >> 4) & 0x0f);
+            px.g += dg;
+            px.b += dg - 8 + (drb & 0x0f);
+        } else if (op == OP_RGB) {
+            px.r = p[0];
+            px.g = p[1];
+            px.b = p[2];
+            p += 3;
+        } else if (op == OP_RGBA) {
+            px.r = p[0];
+            px.g = p[1];
+            px.b = p[2];
+            px.a = p[3];
+            p += 4;
+        } else {
+            // A run repeats the previous pixel, which is already in the
+            // index. Long runs are what transparent areas turn into.
+            size_t run_length = (op & 0x3f) + 1;
+            size_t pixels_left = (out_end - out) / 4;
+            run_length = std::min(run_length, pixels_left);
+            for (size_t i = 0; i < run_length; ++i) {
+                memcpy(out, &px, 4);
+                out += 4;
+            }
+            continue;
+        }
+
+        index[get_index(px)] = px;
+        memcpy(out, &px, 4);
+        out += 4;
+    }
+    return true;
+}
+
+void encode(const Uint8* pixels, int width, int height, int channels,
+            std::vector<Uint8>& out) {
+    SDL_assert(width > 0 && height > 0);
+    SDL_assert(channels == 3 || channels == 4);
+
+    size_t num_pixels = static_cast<size_t>(width) * height;
+
+    out.insert(out.end(), {'q', 'o', 'i', 'f'});
+    write_u32(static_cast<glm::u32>(width), out);
+    write_u32(static_cast<glm::u32>(height), out);
+    out.push_back(static_cast<Uint8>(channels));
+    out.push_back(0);
+
+    Pixel index[64] = {};
+    Pixel prev = {0, 0, 0, 255};
+    int run = 0;
+
+    for (size_t i = 0; i < num_pixels; ++i) {
+        Pixel px;
+        memcpy(&px, pixels + i * 4, 4);
+        if (channels == 3) {
+            px.a = 255;
+        }
+
+        if (px == prev) {
+            ++run;
+            if (run == MAX_RUN || i + 1 == num_pixels) {
+                out.push_back(static_cast<Uint8>(OP_RUN | (run - 1)));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            out.push_back(static_cast<Uint8>(OP_RUN | (run - 1)));
+            run = 0;
+        }
+
+        int index_pos = get_index(px);
+        if (index[index_pos] == px) {
+            out.push_back(static_cast<Uint8>(OP_INDEX | index_pos));
+        } else {
+            index[index_pos] = px;
+
+            if (px.a != prev.a) {
+                out.insert(out.end(), {OP_RGBA, px.r, px.g, px.b, px.a});
+            } else {
+                // The differences wrap around like the decoder's sums do
+                int dr = static_cast<glm::i8>(px.r - prev.r);
+                int dg = static_cast<glm::i8>(px.g - prev.g);
+                int db = static_cast<glm::i8>(px.b - prev.b);
+                int dr_dg = dr - dg;
+                int db_dg = db - dg;
+
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 &&
+                    db <= 1) {
+                    out.push_back(static_cast<Uint8>(OP_DIFF | ((dr + 2) << 4) |
+                                                     ((dg + 2) << 2) |
+                                                     (db + 2)));
+                } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 &&
+                           dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+                    out.push_back(static_cast<Uint8>(OP_LUMA | (dg + 32)));
+                    out.push_back(
+                        static_cast<Uint8>(((dr_dg + 8) << 4) | (db_dg + 8)));
+                } else {
+                    out.insert(out.end(), {OP_RGB, px.r, px.g, px.b});
+                }
+            }
+        }
+        prev = px;
+    }
+
+    out.insert(out.end(), std::begin(END_MARKER), std::end(END_MARKER));
+}
+
+bool has_extension(const char* path) {
+    const char* extension = strrchr(path, '.');
+    return extension && strcmp(extension, ".qoi") == 0;
+}
+
+SDL_Surface* load(const char* path) {
+    MappedFile file;
+    if (!file.open(path)) {
+        SDL_SetError("Can't open %s", path);
+        return nullptr;
+    }
+    const Uint8* data = reinterpret_cast<const Uint8*>(file.data());
+
+    Header header;
+    if (!read_header(data, file.size(), header)) {
+        SDL_SetError("%s is not a qoi file", path);
+        return nullptr;
+    }
+
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(
+        0, static_cast<int>(header.width), static_cast<int>(header.height),
+        32, SDL_PIXELFORMAT_RGBA32);
+    if (!surface) {
+        return nullptr;
+    }
+    // Surfaces of 4 byte pixels have no padding, the decoder writes the rows
+    // back to back
+    SDL_assert(surface->pitch == surface->w * 4);
+
+    if (!decode(data, file.size(), static_cast<Uint8*>(surface->pixels))) {
+        SDL_FreeSurface(surface);
+        SDL_SetError("%s is truncated", path);
+        return nullptr;
+    }
+    return surface;
+}
+
+bool save(SDL_Surface* surface, const char* path) {
+    std::vector<Uint8> pixels(static_cast<size_t>(surface->w) * surface->h *
+                              4);
+    if (!PixelConvert::convert_surface(surface, pixels.data(), false)) {
+        return false;
+    }
+
+    Uint32 color_key;
+    int channels = surface->format->Amask != 0 || surface->format->palette ||
+                           SDL_GetColorKey(surface, &color_key) == 0
+                       ? 4
+                       : 3;
+    std::vector<Uint8> file_buf;
+    encode(pixels.data(), surface->w, surface->h, channels, file_buf);
+
+    SDL_RWops* file_ptr = SDL_RWFromFile(path, "wb");
+    if (!file_ptr) {
+        return false;
+    }
+    size_t written = SDL_RWwrite(file_ptr, file_buf.data(), 1,
+                                 file_buf.size());
+    // Closing flushes, that can fail too
+    bool success = SDL_RWclose(file_ptr) == 0 && written == file_buf.size();
+    if (!success) {
+        SDL_SetError("Can't write %s", path);
+    }
+    return success;
+}
+} // namespace Qoi
@@ -0,0 +1,46 @@
+#pragma once
+#include "pch.h"
+
+// The "Quite OK Image" format (qoiformat.org), lossless like png but without
+// any entropy coding. Every pixel is a short op that refers to the previous
+// pixel or to a small hash table of recent ones, so decoding is a single
+// pass over the file and several times faster than inflating a png.
+// Files are about as big as png files for sprite sheets with large
+// transparent areas and flat colors.
+namespace Qoi {
+// Magic, big endian width and height, channels and colorspace
+const size_t HEADER_SIZE = 14;
+// Same limit as the reference implementation
+const glm::u32 MAX_PIXELS = 400000000;
+
+struct Header {
+    glm::u32 width;
+    glm::u32 height;
+    // 3 for RGB, 4 for RGBA. Decoding always gives RGBA anyway.
+    glm::u8 channels;
+    // 0 for sRGB with linear alpha, 1 for all linear. Only informative.
+    glm::u8 colorspace;
+};
+
+// Returns false if data doesn't start with a valid header
+bool read_header(const Uint8* data, size_t size, Header& header);
+
+// Decodes a whole file into dst, which has to hold width * height * 4
+// bytes. The pixels are packed RGBA8 with straight alpha. Returns false if
+// the file is truncated or the header is invalid.
+bool decode(const Uint8* data, size_t size, Uint8* dst);
+
+// Appends the encoded image to out. pixels are packed RGBA8 with straight
+// alpha, for 3 channels the alpha is ignored.
+void encode(const Uint8* pixels, int width, int height, int channels,
+            std::vector<Uint8>& out);
+
+bool has_extension(const char* path);
+
+// Maps and decodes the file at path into an RGBA32 surface. Returns nullptr
+// and sets the SDL error if that fails. Can be called from any thread.
+SDL_Surface* load(const char* path);
+// Writes a surface of any format, without alpha if the format has none.
+// Returns false and sets the SDL error if that fails.
+bool save(SDL_Surface* surface, const char* path);
+} // namespace Qoi
@@ -0,0 +1,45 @@
+#pragma once
+#include "pch.h"
+#include "RenderTarget.h"
+#include "GLState.h"
+
+void RenderTarget::resize(glm::ivec2 size) {
+    if (fbo != 0 && size == texture.dimensions) {
+        return;
+    }
+
+    if (fbo == 0) {
+        glGenFramebuffers(1, &fbo);
+    }
+    if (texture.id != 0) {
+        GLState::delete_texture(texture.id);
+    }
+
+    texture.dimensions = size;
+    glGenTextures(1, &texture.id);
+    GLState::bind_texture(texture.id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, nullptr);
+    // Drawn at its own size, so there is nothing to filter
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D, texture.id, 0);
+    SDL_assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) ==
+               GL_FRAMEBUFFER_COMPLETE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void RenderTarget::bind() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, texture.dimensions.x, texture.dimensions.y);
+}
+
+void RenderTarget::bind_window(glm::ivec2 window_size) {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, window_size.x, window_size.y);
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "pch.h"
+#include "Texture.h"
+
+// Offscreen framebuffer that renders into a texture. Used to cache what
+// doesn't change every frame, so it can be drawn as one textured quad.
+class RenderTarget {
+    GLuint fbo = 0;
+
+  public:
+    Texture texture;
+
+    // (Re)creates the texture if the size changed, its contents are undefined
+    // after that
+    void resize(glm::ivec2 size);
+
+    // Draws go into the texture until bind_window() is called. Sets the
+    // viewport to the size of the texture.
+    void bind() const;
+    static void bind_window(glm::ivec2 window_size);
+};
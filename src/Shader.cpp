@@ -1,6 +1,7 @@
 #pragma once
 #include "pch.h"
 #include "Shader.h"
+#include "CameraBuffer.h"
 
 static bool check_compile_errors(GLuint object, bool program) {
     GLint success;
@@ -81,43 +82,59 @@ GLuint load_and_compile_shader_from_file(const char* vert_shader_path,
 
 Shader::Shader(const char* vert_path, const char* frag_path) {
     id = load_and_compile_shader_from_file(vert_path, frag_path);
-    projection_loc = glGetUniformLocation(id, "projection");
-    render_position_loc = glGetUniformLocation(id, "render_position");
-}
-
-void Shader::use() const { glUseProgram(id); }
+    render_position = glGetUniformLocation(id, "render_position");
+    texel_scale = glGetUniformLocation(id, "texel_scale");
 
-void Shader::set_projection(glm::mat4 projection) const {
-    glUniformMatrix4fv(projection_loc, 1, GL_FALSE, value_ptr(projection));
+    GLuint camera_index = glGetUniformBlockIndex(id, "Camera");
+    if (camera_index != GL_INVALID_INDEX) {
+        glUniformBlockBinding(id, camera_index, CameraBuffer::BINDING);
+    }
 }
 
-void Shader::set_render_position(glm::vec2 position) const {
-    glUniform2fv(render_position_loc, 1, value_ptr(position));
-}
+void Shader::use() const { GLState::use_program(id); }
 
-SheetShader::SheetShader(const char* vert_path, const char* frag_path)
-    : Shader(vert_path, frag_path) {
-    sprite_dimensions_loc = glGetUniformLocation(id, "sprite_dimensions");
-    set_sprite_position_on_sheet_loc = glGetUniformLocation(id, "sprite_position_on_sheet");
+void Shader::set_render_position(glm::vec2 position) const {
+    if (render_position.update(position)) {
+        glUniform2fv(render_position.location, 1, value_ptr(position));
+    }
 }
 
-void SheetShader::set_sprite_dimensions(glm::vec2 dimensions) const {
-    glUniform2fv(sprite_dimensions_loc, 1, value_ptr(dimensions));
-}
-void SheetShader::set_sprite_position_on_sheet(glm::vec2 position) const {
-    glUniform2fv(set_sprite_position_on_sheet_loc, 1, value_ptr(position));
+void Shader::set_texel_scale(glm::vec2 scale) const {
+    if (texel_scale.update(scale)) {
+        glUniform2fv(texel_scale.location, 1, value_ptr(scale));
+    }
 }
 
 LineShader::LineShader(const char* vert_path, const char* frag_path)
     : Shader(vert_path, frag_path) {
-    sprite_dimensions_loc = glGetUniformLocation(id, "sprite_dimensions");
-    color_loc = glGetUniformLocation(id, "color");
+    sprite_dimensions = glGetUniformLocation(id, "sprite_dimensions");
+    color = glGetUniformLocation(id, "color");
+    first_cell = glGetUniformLocation(id, "first_cell");
+    grid_size = glGetUniformLocation(id, "grid_size");
 }
 
 void LineShader::set_sprite_dimensions(glm::vec2 dimensions) const {
-    glUniform2fv(sprite_dimensions_loc, 1, value_ptr(dimensions));
+    if (sprite_dimensions.update(dimensions)) {
+        glUniform2fv(sprite_dimensions.location, 1, value_ptr(dimensions));
+    }
 }
 
 void LineShader::set_color(glm::vec4 color) const {
-    glUniform4fv(color_loc, 1, value_ptr(color));
+    if (this->color.update(color)) {
+        glUniform4fv(this->color.location, 1, value_ptr(color));
+    }
+}
+
+void LineShader::set_grid_range(glm::ivec2 first_cell, glm::ivec2 size) const {
+    if (this->first_cell.update(first_cell)) {
+        glUniform2iv(this->first_cell.location, 1, value_ptr(first_cell));
+    }
+    if (grid_size.update(size)) {
+        glUniform2iv(grid_size.location, 1, value_ptr(size));
+    }
+}
+
+GLsizei LineShader::get_grid_vertex_count(glm::ivec2 size) {
+    // One line more than there are sprites in each direction
+    return 2 * (size.x + 1 + size.y + 1);
 }
\ No newline at end of file
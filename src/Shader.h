@@ -1,9 +1,15 @@
 #pragma once
 #include "pch.h"
+#include "GLState.h"
 
+// Uniform values are cached, setting a uniform to the value it already has
+// doesn't call GL (see GLState.h). The caches are mutable, they don't change
+// what the shader does.
 class Shader {
   protected:
-    GLuint id, projection_loc, render_position_loc;
+    GLuint id;
+    mutable CachedUniform<glm::vec2> render_position;
+    mutable CachedUniform<glm::vec2> texel_scale;
 
   public:
     Shader() {}
@@ -11,28 +17,18 @@ class Shader {
 
     void use() const;
 
-    void set_projection(glm::mat4 projection) const;
+    // The projection comes from the "Camera" uniform block, see CameraBuffer
     void set_render_position(glm::vec2 position) const;
-};
-
-class SheetShader : public Shader {
-    GLuint sprite_dimensions_loc, set_sprite_position_on_sheet_loc;
-
-  public:
-    SheetShader() {}
-    SheetShader(const char* vert_path, const char* frag_path);
-
-    void set_sprite_dimensions(glm::vec2 dimensions) const;
-
-    // Returns the index of the currently active sprite along the X- and Y-Axis.
-    // These coordinates are used by the shader because the operations necessary
-    // to calculate them from the normal sprite index (namely modulo) are only
-    // supported in the more recent versions of GLSL.
-    void set_sprite_position_on_sheet(glm::vec2 position) const;
+    // Size of a texel of the drawn texture, for textures that are drawn
+    // scaled. Only default.vert has it, for the others it does nothing.
+    void set_texel_scale(glm::vec2 scale) const;
 };
 
 class LineShader : public Shader {
-    GLuint sprite_dimensions_loc, color_loc;
+    mutable CachedUniform<glm::vec2> sprite_dimensions;
+    mutable CachedUniform<glm::vec4> color;
+    mutable CachedUniform<glm::ivec2> first_cell;
+    mutable CachedUniform<glm::ivec2> grid_size;
 
   public:
     LineShader() {}
@@ -40,4 +36,10 @@ class LineShader : public Shader {
 
     void set_sprite_dimensions(glm::vec2 dimensions) const;
     void set_color(glm::vec4 color) const;
+
+    // The sprites from first_cell on, size of them along the X- and Y-Axis.
+    // Their lines are drawn with one
+    // glDrawArrays(GL_LINES, 0, get_grid_vertex_count(size)).
+    void set_grid_range(glm::ivec2 first_cell, glm::ivec2 size) const;
+    static GLsizei get_grid_vertex_count(glm::ivec2 size);
 };
\ No newline at end of file
@@ -0,0 +1,83 @@
+#pragma once
+#include "pch.h"
+#include "SpriteBatch.h"
+#include "GLState.h"
+
+void SpriteBatch::init() {
+    glGenVertexArrays(1, &vao);
+    GLState::bind_vertex_array(vao);
+
+    glGenBuffers(1, &instance_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+
+    // Attribute 0 is left out, the quad has no vertex buffer
+    set_instance_offset(0);
+    for (GLuint attribute = 1; attribute <= 4; ++attribute) {
+        glEnableVertexAttribArray(attribute);
+        glVertexAttribDivisor(attribute, 1);
+    }
+}
+
+void SpriteBatch::set_instance_offset(size_t first_instance) {
+    size_t offset = first_instance * sizeof(Instance);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                          (void*)(offset + offsetof(Instance, position)));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                          (void*)(offset + offsetof(Instance, source)));
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                          (void*)(offset + offsetof(Instance, size)));
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                          (void*)(offset + offsetof(Instance, tint)));
+}
+
+void SpriteBatch::add(GLuint texture, const Instance& instance) {
+    instances.push_back(instance);
+    textures.push_back(texture);
+}
+
+void SpriteBatch::draw() {
+    if (instances.empty()) {
+        return;
+    }
+
+    // Instances on the same texture are drawn together. Usually there is
+    // only one, which keeps the order they were added in.
+    order.resize(instances.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return textures[a] < textures[b];
+    });
+    sorted_instances.clear();
+    for (size_t i : order) {
+        sorted_instances.push_back(instances[i]);
+    }
+
+    GLState::bind_vertex_array(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+
+    // Orphan the old storage, so we don't wait for the last draw that still
+    // reads from it
+    size_t size = instances.size() * sizeof(Instance);
+    if (instances.size() > vbo_capacity) {
+        vbo_capacity = std::max(instances.size(), vbo_capacity * 2);
+    }
+    glBufferData(GL_ARRAY_BUFFER, vbo_capacity * sizeof(Instance), nullptr,
+                 GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, sorted_instances.data());
+
+    // GL 3.3 can't start instanced draws at an instance, the attributes are
+    // moved to the start of every texture's instances instead
+    size_t first = 0;
+    for (size_t i = 1; i <= order.size(); ++i) {
+        if (i < order.size() && textures[order[i]] == textures[order[first]]) {
+            continue;
+        }
+        GLState::bind_texture(textures[order[first]]);
+        set_instance_offset(first);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4,
+                              static_cast<GLsizei>(i - first));
+        first = i;
+    }
+}
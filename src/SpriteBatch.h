@@ -0,0 +1,50 @@
+#pragma once
+#include "pch.h"
+
+// Draws many sprites with as few instanced draw calls as possible, one for
+// every texture the sprites are on. Every sprite is one instance with its
+// own position, part of the texture and tint, the quad is generated in
+// batch.vert.
+class SpriteBatch {
+  public:
+    struct Instance {
+        // Top left corner
+        glm::vec2 position;
+        // Top left corner of the sprite on the texture, in texels
+        glm::vec2 source;
+        // In texels, which is also the size it's drawn at
+        glm::vec2 size;
+        glm::vec4 tint;
+    };
+
+  private:
+    GLuint vao = 0, instance_vbo = 0;
+    // Number of instances that fit into instance_vbo
+    size_t vbo_capacity = 0;
+
+    std::vector<Instance> instances;
+    // Texture of every instance
+    std::vector<GLuint> textures;
+
+    // Reused by draw(), the instances sorted by texture
+    std::vector<size_t> order;
+    std::vector<Instance> sorted_instances;
+
+    // The instance attributes start at first_instance in instance_vbo
+    void set_instance_offset(size_t first_instance);
+
+  public:
+    // Creates the buffers, needs a GL context
+    void init();
+
+    void clear() {
+        instances.clear();
+        textures.clear();
+    }
+    void add(GLuint texture, const Instance& instance);
+    size_t size() const { return instances.size(); }
+
+    // Uploads the instances and draws them, binding their textures. The batch
+    // shader has to be in use.
+    void draw();
+};
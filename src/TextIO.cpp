@@ -0,0 +1,187 @@
+#pragma once
+#include "pch.h"
+#include "TextIO.h"
+
+#include <emmintrin.h>
+#include <intrin.h>
+
+const char* find_char(const char* first, const char* last, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+
+    while (last - first >= 16) {
+        __m128i chunk =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+        if (mask != 0) {
+            unsigned long index;
+            _BitScanForward(&index, static_cast<unsigned long>(mask));
+            return first + index;
+        }
+        first += 16;
+    }
+
+    while (first != last && *first != c) {
+        ++first;
+    }
+    return first;
+}
+
+static std::string_view trim(std::string_view str) {
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+        str.remove_prefix(1);
+    }
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) {
+        str.remove_suffix(1);
+    }
+    return str;
+}
+
+// Parses the whole string as a number, without copying it
+template <typename T> static bool parse_number(std::string_view str, T& value) {
+    str = trim(str);
+    const char* last = str.data() + str.size();
+    auto result = std::from_chars(str.data(), last, value);
+    return result.ec == std::errc() && result.ptr == last;
+}
+
+TextReader::TextReader(const char* buf, size_t size)
+    : begin(buf), next_char(buf), end(buf + size) {}
+
+bool TextReader::next_line(std::string_view& line) {
+    while (next_char != end) {
+        const char* line_start = next_char;
+        const char* line_end = find_char(next_char, end, '\n');
+        next_char = line_end == end ? end : line_end + 1;
+
+        if (*line_start == '#') {
+            // Comment, skip line
+            continue;
+        }
+
+        // To deal with different end of line sequences
+        if (line_end != line_start && line_end[-1] == '\r') {
+            --line_end;
+        }
+        line = std::string_view(line_start, line_end - line_start);
+        return true;
+    }
+    return false;
+}
+
+bool TextReader::read_int(glm::i32& value) {
+    std::string_view line;
+    return next_line(line) && parse_number(line, value);
+}
+
+bool TextReader::read_size(size_t& value) {
+    std::string_view line;
+    return next_line(line) && parse_number(line, value);
+}
+
+bool TextReader::read_float(float& value) {
+    std::string_view line;
+    return next_line(line) && parse_number(line, value);
+}
+
+bool TextReader::read_int_pair(glm::ivec2& value) {
+    std::string_view line;
+    if (!next_line(line)) {
+        return false;
+    }
+
+    size_t comma = line.find(',');
+    if (comma == std::string_view::npos) {
+        return false;
+    }
+    return parse_number(line.substr(0, comma), value.x) &&
+           parse_number(line.substr(comma + 1), value.y);
+}
+
+static size_t count_bits(glm::u32 mask) {
+    size_t count = 0;
+    while (mask) {
+        mask &= mask - 1;
+        ++count;
+    }
+    return count;
+}
+
+bool TextReader::skip_lines(size_t count) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i hash = _mm_set1_epi8('#');
+
+    while (count > 0) {
+        // Fast path: As long as a block contains no # at all, it can't contain
+        // a comment either, so each newline in it ends a line to be skipped.
+        if (end - next_char >= 16) {
+            __m128i chunk =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(next_char));
+            glm::u32 newline_mask = static_cast<glm::u32>(
+                _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+            glm::u32 hash_mask = static_cast<glm::u32>(
+                _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, hash)));
+            size_t num_newlines = count_bits(newline_mask);
+
+            if (hash_mask == 0 && num_newlines < count) {
+                count -= num_newlines;
+                next_char += 16;
+                continue;
+            }
+        }
+
+        // Slow path for comments and the last lines
+        std::string_view line;
+        if (!next_line(line)) {
+            return false;
+        }
+        --count;
+    }
+    return true;
+}
+
+// Enough for any integer or float formatted by std::to_chars
+static const size_t MAX_NUMBER_LENGTH = 32;
+
+char* TextWriter::reserve_space(size_t count) {
+    if (used + count > buf.size()) {
+        buf.resize(std::max(buf.size() * 2, used + count));
+    }
+    return buf.data() + used;
+}
+
+void TextWriter::reserve(size_t capacity) {
+    if (capacity > buf.size()) {
+        buf.resize(capacity);
+    }
+}
+
+void TextWriter::write(std::string_view str) {
+    memcpy(reserve_space(str.size()), str.data(), str.size());
+    used += str.size();
+}
+
+void TextWriter::write_char(char c) {
+    *reserve_space(1) = c;
+    ++used;
+}
+
+void TextWriter::write_int(glm::i32 value) {
+    char* first = reserve_space(MAX_NUMBER_LENGTH);
+    auto result = std::to_chars(first, first + MAX_NUMBER_LENGTH, value);
+    SDL_assert(result.ec == std::errc());
+    used = result.ptr - buf.data();
+}
+
+void TextWriter::write_size(size_t value) {
+    char* first = reserve_space(MAX_NUMBER_LENGTH);
+    auto result = std::to_chars(first, first + MAX_NUMBER_LENGTH, value);
+    SDL_assert(result.ec == std::errc());
+    used = result.ptr - buf.data();
+}
+
+void TextWriter::write_float(float value) {
+    char* first = reserve_space(MAX_NUMBER_LENGTH);
+    auto result = std::to_chars(first, first + MAX_NUMBER_LENGTH, value);
+    SDL_assert(result.ec == std::errc());
+    used = result.ptr - buf.data();
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "pch.h"
+
+// Returns a pointer to the first occurrence of c in [first, last) or last if
+// there is none. Scans 16 bytes at a time.
+const char* find_char(const char* first, const char* last, char c);
+
+// Line based reader for the .anim text format. Works directly on the file
+// buffer, which doesn't need to be null terminated, and never reads past
+// its end. Lines starting with # are comments and are skipped.
+class TextReader {
+    const char* begin;
+    const char* next_char;
+    const char* end;
+
+  public:
+    TextReader(const char* buf, size_t size);
+
+    // Returns the next line that is not a comment, without its line ending.
+    // Returns false if the end of the buffer is reached.
+    bool next_line(std::string_view& line);
+
+    // Each of these reads one line. They return false at the end of the
+    // buffer or if the line doesn't contain exactly the expected value.
+    bool read_int(glm::i32& value);
+    bool read_size(size_t& value);
+    bool read_float(float& value);
+    // Two integers on one line, separated by a comma
+    bool read_int_pair(glm::ivec2& value);
+
+    // Skips count lines that are not comments without looking at their
+    // content. Returns false if the buffer ends before that.
+    bool skip_lines(size_t count);
+
+    size_t offset() const { return next_char - begin; }
+    size_t bytes_left() const { return end - next_char; }
+    bool at_end() const { return next_char == end; }
+};
+
+// Formats text into one growable buffer, so a whole file can be written with
+// a single call. Numbers are formatted with std::to_chars, floats use the
+// shortest representation that reads back to the same value.
+class TextWriter {
+    std::vector<char> buf;
+    size_t used = 0;
+
+    // Returns a pointer to at least count writable chars at the end of the
+    // used part of the buffer.
+    char* reserve_space(size_t count);
+
+  public:
+    void reserve(size_t capacity);
+    void clear() { used = 0; }
+
+    void write(std::string_view str);
+    void write_char(char c);
+    void write_int(glm::i32 value);
+    void write_size(size_t value);
+    void write_float(float value);
+
+    const char* data() const { return buf.data(); }
+    size_t size() const { return used; }
+};
@@ -1,32 +1,157 @@
 #pragma once
 #include "pch.h"
 #include "Texture.h"
+#include "GLState.h"
+#include "PixelConvert.h"
+#include "Qoi.h"
+
+SDL_Surface* load_image(const char* path) {
+    if (Qoi::has_extension(path)) {
+        return Qoi::load(path);
+    }
+    return IMG_Load(path);
+}
+
+// Returns a surface over the cached pixels, or nullptr on a miss
+static SDL_Surface* map_cached_image(const ImageCache::Key& key,
+                                     std::unique_ptr<MappedFile>& cache_file) {
+    auto file = std::make_unique<MappedFile>();
+    glm::ivec2 size;
+    const Uint8* pixels;
+    if (!ImageCache::find(key, *file, size, pixels)) {
+        return nullptr;
+    }
+
+    // The surface only points into the mapping, which is read only. Nothing
+    // writes to the pixels of these surfaces.
+    SDL_Surface* img = SDL_CreateRGBSurfaceWithFormatFrom(
+        const_cast<Uint8*>(pixels), size.x, size.y, 32, size.x * 4,
+        SDL_PIXELFORMAT_RGBA32);
+    if (img) {
+        cache_file = std::move(file);
+    }
+    return img;
+}
+
+SDL_Surface* load_texture_image(const char* path,
+                                std::unique_ptr<MappedFile>& cache_file,
+                                PendingCacheStore* deferred_store) {
+    ImageCache::Key key;
+    bool cacheable = ImageCache::get_key(path, key);
+    if (cacheable) {
+        SDL_Surface* img = map_cached_image(key, cache_file);
+        if (img) {
+            return img;
+        }
+    }
+
+    SDL_Surface* img = load_image(path);
+    if (!img) {
+        return nullptr;
+    }
+
+    // If it can be, the image is converted straight into the cache file and
+    // mapped from there. The converted pixels then never take up memory
+    // of their own, only pages of the file that the system can drop and
+    // read again.
+    if (cacheable && PixelConvert::can_convert_rows(img)) {
+        bool stored = ImageCache::store_rows(
+            key, {img->w, img->h}, [img](int first_row, int num_rows,
+                                         Uint8* dst) {
+                PixelConvert::convert_rows(img, first_row, num_rows, dst,
+                                           PREMULTIPLIED_ALPHA);
+            });
+        SDL_Surface* mapped =
+            stored ? map_cached_image(key, cache_file) : nullptr;
+        if (mapped) {
+            SDL_FreeSurface(img);
+            return mapped;
+        }
+        // Storing it again below would fail the same way
+        cacheable = false;
+    }
+
+    // Images that already are packed RGBA8 get premultiplied in place
+    bool in_place = img->format->format == SDL_PIXELFORMAT_RGBA32 &&
+                    img->pitch == img->w * 4;
+    SDL_Surface* converted =
+        in_place ? img
+                 : SDL_CreateRGBSurfaceWithFormat(0, img->w, img->h, 32,
+                                                  SDL_PIXELFORMAT_RGBA32);
+    if (converted &&
+        !PixelConvert::convert_surface(img,
+                                       static_cast<Uint8*>(converted->pixels),
+                                       PREMULTIPLIED_ALPHA)) {
+        SDL_FreeSurface(converted);
+        converted = nullptr;
+    }
+    if (!in_place) {
+        SDL_FreeSurface(img);
+    }
+
+    if (converted && cacheable) {
+        if (deferred_store) {
+            deferred_store->pending = true;
+            deferred_store->key = key;
+        } else {
+            ImageCache::store(key, {converted->w, converted->h},
+                              static_cast<const Uint8*>(converted->pixels));
+        }
+    }
+    return converted;
+}
 
 void Texture::load_from_file(const char* path) {
-    glDeleteTextures(1, &id);
+    std::unique_ptr<MappedFile> cache_file;
+    SDL_Surface* img = load_texture_image(path, cache_file);
+    if (!img) {
+        printf("ERROR: Can't load %s: %s\n", path, SDL_GetError());
+        return;
+    }
 
-    SDL_Surface* img = IMG_Load(path);
-    SDL_assert(img);
+    load_from_pixels(static_cast<const Uint8*>(img->pixels), {img->w, img->h});
 
-    dimensions.x = img->w;
-    dimensions.y = img->h;
+    SDL_FreeSurface(img);
+}
+
+void Texture::share(const Texture& other) {
+    id = other.id;
+    dimensions = other.dimensions;
+    owns_id = false;
+}
+
+void Texture::load_from_surface(SDL_Surface* img) {
+    // Loaders return whatever format the file has, GL gets packed RGBA8
+    std::vector<Uint8> pixels(static_cast<size_t>(img->w) * img->h * 4);
+    if (!PixelConvert::convert_surface(img, pixels.data(),
+                                       PREMULTIPLIED_ALPHA)) {
+        printf("ERROR: Can't convert image: %s\n", SDL_GetError());
+        pixels.assign(pixels.size(), 0);
+    }
+
+    load_from_pixels(pixels.data(), {img->w, img->h});
+}
+
+void Texture::load_from_pixels(const Uint8* pixels, glm::ivec2 size) {
+    if (id != 0 && owns_id) {
+        GLState::delete_texture(id);
+    }
+
+    dimensions = size;
+    owns_id = true;
 
     glGenTextures(1, &id);
-    glBindTexture(GL_TEXTURE_2D, id);
+    GLState::bind_texture(id);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, dimensions.x, dimensions.y, 0,
-                 GL_RGBA, GL_UNSIGNED_BYTE, img->pixels);
+                 GL_RGBA, GL_UNSIGNED_BYTE, pixels);
     // NOTE: Is this actually useful?
     // glGenerateMipmap(GL_TEXTURE_2D);
-    SDL_FreeSurface(img);
 
     // Set Texture wrap and filter modes
     // NOTE: Is this specific to one texture or a global setting?
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // @OPTIMIZATION: delete this
-    // Unbind texture
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // Zoomed in sprites keep sharp pixels
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 }
\ No newline at end of file
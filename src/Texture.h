@@ -1,9 +1,57 @@
 #pragma once
 #include "pch.h"
+#include "ImageCache.h"
+#include "MappedFile.h"
+
+// Textures store the color multiplied by the alpha. That also keeps linear
+// filtering from bleeding the color of transparent texels. The blend func
+// has to match, see Application.
+static const bool PREMULTIPLIED_ALPHA = true;
+
+// Decodes a png or qoi file, picked by the extension, into a surface of
+// whatever format the file has. Returns nullptr if that fails. Safe to call
+// from worker threads once IMG_Init was called.
+SDL_Surface* load_image(const char* path);
+
+// A decoded image that wasn't written to the ImageCache yet
+struct PendingCacheStore {
+    bool pending = false;
+    ImageCache::Key key;
+};
+
+// Loads an image file as packed RGBA8 in the format the textures store, so
+// the pixels of the surface can be uploaded as they are. Images that were
+// loaded before are mapped from the ImageCache instead of being decoded,
+// cache_file then holds the pixels and has to outlive the surface. Returns
+// nullptr if that fails. Safe to call from worker threads like load_image.
+//
+// Decoded images are written to the cache before this returns. Most are
+// converted straight into the cache file and mapped from there as well, so
+// only the decoded image has to fit into memory. The ones that SDL has to
+// convert first are converted in memory. With deferred_store, writing those
+// is left to the caller instead, so the image can be used first. If
+// deferred_store->pending is set, the caller has to pass the pixels to
+// ImageCache::store() with its key.
+SDL_Surface* load_texture_image(const char* path,
+                                std::unique_ptr<MappedFile>& cache_file,
+                                PendingCacheStore* deferred_store = nullptr);
 
 struct Texture {
-    GLuint id;
-    glm::ivec2 dimensions;
+    GLuint id = 0;
+    glm::ivec2 dimensions = {0, 0};
+    // False if id belongs to another texture, loading then creates a new one
+    // instead of deleting it
+    bool owns_id = true;
+
+    // Uses the GL texture of other, which has to outlive this one
+    void share(const Texture& other);
 
+    // Leaves the texture as it was if the file can't be loaded
     void load_from_file(const char* path);
+    // Uploads an image that was already decoded in any format, the surface
+    // is not freed. Has to be called on the thread that owns the GL context.
+    void load_from_surface(SDL_Surface* img);
+    // Uploads packed RGBA8 that is already in the format textures store,
+    // e.g. the pixels of a surface from load_texture_image()
+    void load_from_pixels(const Uint8* pixels, glm::ivec2 size);
 };
\ No newline at end of file
@@ -0,0 +1,143 @@
+#pragma once
+#include "pch.h"
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(size_t num_threads) {
+    if (num_threads == 0) {
+        num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    workers.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+        workers.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_changed.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        jobs.push_back(std::move(job));
+        ++num_unfinished;
+    }
+    queue_changed.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    all_done.wait(lock, [this] { return num_unfinished == 0; });
+}
+
+void ThreadPool::work() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_changed.wait(lock,
+                               [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) {
+                // Only happens when stopping
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        job();
+
+        bool finished_last;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            finished_last = --num_unfinished == 0;
+        }
+        if (finished_last) {
+            all_done.notify_all();
+        }
+    }
+}
+
+namespace {
+// Chunks owned by one thread of a parallel_for(). The owner takes them from
+// the front, other threads steal from the back.
+struct ChunkQueue {
+    std::mutex mutex;
+    std::deque<size_t> chunks;
+
+    bool pop_front(size_t& chunk) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (chunks.empty()) {
+            return false;
+        }
+        chunk = chunks.front();
+        chunks.pop_front();
+        return true;
+    }
+
+    bool pop_back(size_t& chunk) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (chunks.empty()) {
+            return false;
+        }
+        chunk = chunks.back();
+        chunks.pop_back();
+        return true;
+    }
+};
+} // namespace
+
+void ThreadPool::parallel_for(size_t count, size_t chunk_size,
+                              const std::function<void(size_t, size_t)>& fn) {
+    SDL_assert(chunk_size > 0);
+    size_t num_chunks = (count + chunk_size - 1) / chunk_size;
+    if (num_chunks == 0) {
+        return;
+    }
+
+    // The calling thread works as well instead of just waiting
+    size_t num_participants = std::min(workers.size() + 1, num_chunks);
+    std::vector<ChunkQueue> queues(num_participants);
+    for (size_t chunk = 0; chunk < num_chunks; ++chunk) {
+        // Contiguous shares, neighbouring chunks stay on the same thread
+        queues[chunk * num_participants / num_chunks].chunks.push_back(chunk);
+    }
+
+    auto run = [&](size_t self) {
+        size_t chunk;
+        while (true) {
+            if (!queues[self].pop_front(chunk)) {
+                // Out of work, try to steal from the others
+                bool stolen = false;
+                for (size_t i = 1; i < num_participants && !stolen; ++i) {
+                    stolen =
+                        queues[(self + i) % num_participants].pop_back(chunk);
+                }
+                if (!stolen) {
+                    // Nothing is ever added, so every queue stays empty now
+                    return;
+                }
+            }
+            size_t begin = chunk * chunk_size;
+            fn(begin, std::min(begin + chunk_size, count));
+        }
+    };
+
+    for (size_t i = 1; i < num_participants; ++i) {
+        submit([&run, i] { run(i); });
+    }
+    run(0);
+
+    // The workers use the queues until they return
+    wait();
+}
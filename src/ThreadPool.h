@@ -0,0 +1,42 @@
+#pragma once
+#include "pch.h"
+
+// Fixed number of worker threads that run submitted jobs in the order they
+// were submitted.
+class ThreadPool {
+    std::vector<std::thread> workers;
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_changed;
+    std::condition_variable all_done;
+    std::deque<std::function<void()>> jobs;
+    // Jobs that were submitted but haven't finished yet
+    size_t num_unfinished = 0;
+    bool stopping = false;
+
+    void work();
+
+  public:
+    // num_threads == 0 uses one thread per hardware thread
+    explicit ThreadPool(size_t num_threads = 0);
+    // Finishes all submitted jobs before returning
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> job);
+    // Blocks until every submitted job has finished
+    void wait();
+
+    // Splits [0, count) into chunks of chunk_size and calls fn(begin, end)
+    // for each of them on the workers and the calling thread. Returns once
+    // every chunk is done. Each thread starts with an equal share of the
+    // chunks and steals from the others once it runs out, so all threads stay
+    // busy even if some chunks take longer. Also waits for the jobs that
+    // were submitted before, so it can't be called from a worker.
+    void parallel_for(size_t count, size_t chunk_size,
+                      const std::function<void(size_t, size_t)>& fn);
+
+    size_t num_threads() const { return workers.size(); }
+};
@@ -0,0 +1,399 @@
+#pragma once
+#include "pch.h"
+#include "TiledTexture.h"
+#include "GLState.h"
+#include "Shader.h"
+#include "SpriteBatch.h"
+
+static const Uint32 PLACEHOLDER_COLOR = 0xff505050;
+
+TiledTexture::~TiledTexture() { clear(); }
+
+void TiledTexture::start_loading(const char* new_path,
+                                 glm::ivec2 expected_dimensions) {
+    clear();
+
+    GLint max_texture_size;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+    tile_size = std::min(MAX_TILE_SIZE, static_cast<int>(max_texture_size));
+    max_overview_size =
+        std::min(MAX_OVERVIEW_SIZE, static_cast<int>(max_texture_size));
+
+    if (placeholder == 0) {
+        glGenTextures(1, &placeholder);
+        GLState::bind_texture(placeholder);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, &PLACEHOLDER_COLOR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    // IMG_Load initializes the png loader lazily, which is not thread safe
+    IMG_Init(IMG_INIT_PNG);
+
+    path = new_path;
+    dimensions = expected_dimensions;
+    decode_state = DecodeState::DECODING;
+    decoder = std::thread(&TiledTexture::decode, this);
+}
+
+// Runs on the decoder thread
+void TiledTexture::decode() {
+    // The tiles are uploaded straight from the image. With the cache, it's
+    // mapped from the cache file, and after the first time the sheet is
+    // opened it isn't even decoded.
+    PendingCacheStore cache_store;
+    SDL_Surface* img =
+        load_texture_image(path.c_str(), decoded_file, &cache_store);
+    if (!img) {
+        decode_state = DecodeState::FAILED;
+        return;
+    }
+
+    // Scaling down the whole image takes a while too, so it's done here
+    // instead of on the GL thread
+    if (img->w > tile_size || img->h > tile_size) {
+        overview_scale = 1.0f;
+        while (std::max(img->w, img->h) * overview_scale > max_overview_size) {
+            overview_scale *= 0.5f;
+        }
+
+        glm::ivec2 overview_dimensions =
+            glm::max(glm::ivec2(glm::vec2(img->w, img->h) * overview_scale),
+                     glm::ivec2(1));
+        decoded_overview = SDL_CreateRGBSurfaceWithFormat(
+            0, overview_dimensions.x, overview_dimensions.y, 32,
+            SDL_PIXELFORMAT_RGBA32);
+        SDL_SetSurfaceBlendMode(img, SDL_BLENDMODE_NONE);
+        SDL_BlitScaled(img, nullptr, decoded_overview, nullptr);
+    }
+
+    detected_grid = GridDetect::detect(static_cast<const Uint8*>(img->pixels),
+                                       img->pitch, {img->w, img->h});
+
+    decoded_image = img;
+    decode_state = DecodeState::DONE;
+
+    // Only written to the cache once the image was handed over, so opening
+    // a sheet for the first time doesn't wait for that. Nothing changes the
+    // pixels, and clear() waits for this thread before it frees them.
+    if (cache_store.pending) {
+        ImageCache::store(cache_store.key, {img->w, img->h},
+                          static_cast<const Uint8*>(img->pixels));
+    }
+}
+
+void TiledTexture::finish_decoding() {
+    // The decoder might still be writing the image to the cache, it's
+    // joined in clear()
+    decode_state = DecodeState::IDLE;
+
+    image = decoded_image;
+    decoded_image = nullptr;
+    image_file = std::move(decoded_file);
+    dimensions = {image->w, image->h};
+
+    num_tiles = (dimensions + tile_size - 1) / tile_size;
+    tiles.assign(static_cast<size_t>(num_tiles.x) * num_tiles.y, Tile());
+
+    overview_image = decoded_overview;
+    decoded_overview = nullptr;
+    if (overview_image) {
+        overview.dimensions = {overview_image->w, overview_image->h};
+        overview.id = create_texture(overview.dimensions);
+        uploads.push_back({overview.id, overview_image, {0, 0},
+                           overview.dimensions, 0, &overview_ready});
+    }
+}
+
+void TiledTexture::clear() {
+    if (decoder.joinable()) {
+        decoder.join();
+    }
+    decode_state = DecodeState::IDLE;
+    for (SDL_Surface* surface : {decoded_image, decoded_overview,
+                                 overview_image, image}) {
+        if (surface) {
+            SDL_FreeSurface(surface);
+        }
+    }
+    decoded_image = decoded_overview = overview_image = image = nullptr;
+    decoded_file.reset();
+    image_file.reset();
+    detected_grid = GridDetect::Grid();
+    uploads.clear();
+
+    for (auto& tile : tiles) {
+        if (tile.texture != 0) {
+            GLState::delete_texture(tile.texture);
+        }
+    }
+    tiles.clear();
+    num_tiles = {0, 0};
+    num_resident = 0;
+
+    if (overview.id != 0) {
+        GLState::delete_texture(overview.id);
+        overview = Texture();
+    }
+    overview_ready = false;
+    overview_scale = 1.0f;
+
+    dimensions = {0, 0};
+}
+
+bool TiledTexture::update() {
+    bool changed = false;
+
+    DecodeState state = decode_state;
+    if (state == DecodeState::DONE) {
+        finish_decoding();
+        changed = true;
+    } else if (state == DecodeState::FAILED) {
+        printf("ERROR: Can't load sprite sheet %s\n", path.c_str());
+        clear();
+        changed = true;
+    }
+
+    // Rows that didn't fit into the budget are uploaded in the next frames
+    size_t budget = UPLOAD_BYTES_PER_FRAME;
+    while (!uploads.empty() && budget > 0) {
+        if (upload_chunk(budget)) {
+            changed = true;
+        }
+    }
+
+    // The overview is the only upload that doesn't read from image
+    if (overview_ready && overview_image) {
+        SDL_FreeSurface(overview_image);
+        overview_image = nullptr;
+    }
+
+    return changed;
+}
+
+GLuint TiledTexture::create_texture(glm::ivec2 size) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    GLState::bind_texture(texture);
+
+    // Only allocates the storage, the pixels follow in upload_chunk()
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size.x, size.y, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, nullptr);
+
+    // Same as Texture, tiles are never sampled across their edges
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    return texture;
+}
+
+bool TiledTexture::upload_chunk(size_t& budget) {
+    Upload& upload = uploads.front();
+    // At least one row, even if it's bigger than the budget
+    size_t row_size = static_cast<size_t>(upload.size.x) * 4;
+    int rows = static_cast<int>(
+        std::min(static_cast<size_t>(upload.size.y - upload.rows_done),
+                 std::max<size_t>(budget / row_size, 1)));
+    size_t chunk_size = rows * row_size;
+    budget -= std::min(budget, chunk_size);
+
+    if (pbo == 0) {
+        glGenBuffers(1, &pbo);
+    }
+
+    // Orphaning the storage lets the driver hand out new memory while it
+    // still copies the last chunk, instead of waiting for that to finish
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, chunk_size, nullptr, GL_STREAM_DRAW);
+    Uint8* dst = static_cast<Uint8*>(
+        glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, chunk_size,
+                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if (dst) {
+        const Uint8* src = static_cast<const Uint8*>(upload.source->pixels) +
+                           (upload.origin.y + upload.rows_done) *
+                               upload.source->pitch +
+                           upload.origin.x * 4;
+        for (int row = 0; row < rows; ++row) {
+            memcpy(dst + row * row_size, src + row * upload.source->pitch,
+                   row_size);
+        }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        // Reads from the buffer, the copy to the texture doesn't block
+        GLState::bind_texture(upload.texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, upload.rows_done, upload.size.x,
+                        rows, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+
+    // Every other upload passes a pointer to client memory
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    // A failed map is retried in the next frame
+    if (!dst) {
+        budget = 0;
+        return false;
+    }
+
+    upload.rows_done += rows;
+    if (upload.rows_done < upload.size.y) {
+        return false;
+    }
+    *upload.ready = true;
+    uploads.pop_front();
+    return true;
+}
+
+glm::ivec2 TiledTexture::get_tile_size(glm::ivec2 tile) const {
+    // The last tiles in a row or column only cover the rest of the image
+    return glm::min(glm::ivec2(tile_size), dimensions - tile * tile_size);
+}
+
+GLuint TiledTexture::use_tile(glm::ivec2 tile_position) {
+    Tile& tile = tiles[tile_position.y * num_tiles.x + tile_position.x];
+    if (tile.texture == 0) {
+        if (num_resident >= MAX_RESIDENT_TILES) {
+            evict_unused_tile();
+        }
+        glm::ivec2 size = get_tile_size(tile_position);
+        tile.texture = create_texture(size);
+        uploads.push_back({tile.texture, image, tile_position * tile_size,
+                           size, 0, &tile.ready});
+        ++num_resident;
+    }
+    tile.last_used = frame;
+    return tile.ready ? tile.texture : 0;
+}
+
+void TiledTexture::evict_unused_tile() {
+    // Least recently used, but never one that is drawn in this frame or still
+    // queued for upload. If all of them are, there are more tiles than
+    // MAX_RESIDENT_TILES until some aren't visible anymore.
+    Tile* oldest = nullptr;
+    for (auto& tile : tiles) {
+        if (tile.ready && tile.last_used < frame &&
+            (!oldest || tile.last_used < oldest->last_used)) {
+            oldest = &tile;
+        }
+    }
+
+    if (oldest) {
+        GLState::delete_texture(oldest->texture);
+        oldest->texture = 0;
+        oldest->ready = false;
+        --num_resident;
+    }
+}
+
+void TiledTexture::draw_placeholder(const Shader& shader, glm::vec2 position,
+                                    glm::vec2 size) {
+    shader.set_texel_scale(size);
+    shader.set_render_position(position);
+    GLState::bind_texture(placeholder);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+void TiledTexture::draw(const Shader& shader, glm::vec2 visible_min,
+                        glm::vec2 visible_max, float zoom) {
+    if (is_decoding()) {
+        draw_placeholder(shader, {0.0f, 0.0f}, dimensions);
+        return;
+    }
+    if (!image) {
+        return;
+    }
+
+    // The overview has at least as many texels as there are pixels on screen
+    if (overview.id != 0 && zoom <= overview_scale) {
+        if (!overview_ready) {
+            draw_placeholder(shader, {0.0f, 0.0f}, dimensions);
+            return;
+        }
+        shader.set_texel_scale(glm::vec2(dimensions) /
+                               glm::vec2(overview.dimensions));
+        shader.set_render_position({0.0f, 0.0f});
+        GLState::bind_texture(overview.id);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        return;
+    }
+
+    float size = static_cast<float>(tile_size);
+    glm::ivec2 first_tile =
+        glm::clamp(glm::ivec2(glm::floor(visible_min / size)), glm::ivec2(0),
+                   num_tiles);
+    glm::ivec2 end_tile = glm::clamp(
+        glm::ivec2(glm::ceil(visible_max / size)), first_tile, num_tiles);
+
+    for (int y = first_tile.y; y < end_tile.y; ++y) {
+        for (int x = first_tile.x; x < end_tile.x; ++x) {
+            glm::vec2 position = glm::vec2(x, y) * size;
+            GLuint texture = use_tile({x, y});
+            if (texture == 0) {
+                draw_placeholder(shader, position, get_tile_size({x, y}));
+                continue;
+            }
+
+            shader.set_texel_scale({1.0f, 1.0f});
+            shader.set_render_position(position);
+            GLState::bind_texture(texture);
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        }
+    }
+}
+
+void TiledTexture::add_sprite(SpriteBatch& batch, glm::vec2 position,
+                              glm::i32 sprite_index,
+                              glm::ivec2 sprite_dimensions, glm::vec4 tint) {
+    if (sprite_index < 0 || sprite_dimensions.x <= 0 ||
+        sprite_dimensions.y <= 0 || sprite_dimensions.x > dimensions.x) {
+        return;
+    }
+
+    // The placeholder is a single texel, any source rect samples it
+    SpriteBatch::Instance instance;
+    instance.source = {0.0f, 0.0f};
+    instance.tint = tint;
+    if (is_decoding()) {
+        instance.position = position;
+        instance.size = glm::vec2(sprite_dimensions);
+        batch.add(placeholder, instance);
+        return;
+    }
+    if (!image) {
+        return;
+    }
+
+    glm::i32 sprites_per_row = dimensions.x / sprite_dimensions.x;
+    glm::ivec2 cell = {sprite_index % sprites_per_row,
+                       sprite_index / sprites_per_row};
+    glm::ivec2 source_min = cell * sprite_dimensions;
+    glm::ivec2 source_max =
+        glm::min(source_min + sprite_dimensions, dimensions);
+    if (source_min.y >= source_max.y) {
+        return;
+    }
+
+    // One instance for the part of the sprite on each tile
+    glm::ivec2 first_tile = source_min / tile_size;
+    glm::ivec2 last_tile = (source_max - 1) / tile_size;
+    for (int y = first_tile.y; y <= last_tile.y; ++y) {
+        for (int x = first_tile.x; x <= last_tile.x; ++x) {
+            glm::ivec2 tile_origin = glm::ivec2(x, y) * tile_size;
+            glm::ivec2 part_min = glm::max(source_min, tile_origin);
+            glm::ivec2 part_max = glm::min(source_max, tile_origin + tile_size);
+
+            GLuint texture = use_tile({x, y});
+            instance.position = position + glm::vec2(part_min - source_min);
+            instance.source = glm::vec2(part_min - tile_origin);
+            instance.size = glm::vec2(part_max - part_min);
+            if (texture == 0) {
+                texture = placeholder;
+                instance.source = {0.0f, 0.0f};
+            }
+            batch.add(texture, instance);
+        }
+    }
+}
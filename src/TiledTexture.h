@@ -0,0 +1,160 @@
+#pragma once
+#include "pch.h"
+#include "GridDetect.h"
+#include "Texture.h"
+
+class Shader;
+class SpriteBatch;
+
+// Sprite sheet that is split into tiles with one texture each, so sheets
+// bigger than GL_MAX_TEXTURE_SIZE can be shown. A tile is only uploaded once
+// it's drawn. Tiles that weren't drawn for a while are deleted again when
+// more than MAX_RESIDENT_TILES are uploaded, so the video memory that is
+// used depends on what is visible instead of on the size of the sheet.
+// The tiles are uploaded from the converted image, which is kept for as
+// long as the sheet is open, 4 bytes per pixel, e.g. 1 GB for a 16k x 16k
+// sheet. With the ImageCache, it's converted straight into the cache file
+// and mapped from there, so its pages are backed by the file and the system
+// can drop them under memory pressure. Only without the cache, or for
+// images too big for it, the whole image stays on the heap.
+// Zoomed out far enough, a scaled down copy of the whole sheet is drawn
+// instead of the tiles.
+//
+// Nothing of this blocks the main loop: the image is decoded on a worker
+// thread and the textures are uploaded through a pixel buffer object, at
+// most UPLOAD_BYTES_PER_FRAME in each call to update(). Until a texture is
+// complete, a placeholder is drawn in its place.
+class TiledTexture {
+  public:
+    // Smaller if GL_MAX_TEXTURE_SIZE is
+    static const int MAX_TILE_SIZE = 1024;
+    static const size_t MAX_RESIDENT_TILES = 48;
+    // Longest side of the scaled down copy
+    static const int MAX_OVERVIEW_SIZE = 4096;
+    // One tile per frame, copying it takes about a millisecond
+    static const size_t UPLOAD_BYTES_PER_FRAME = 4 * 1024 * 1024;
+
+  private:
+    struct Tile {
+        GLuint texture = 0;
+        // False while the upload is still queued
+        bool ready = false;
+        // Frame the tile was last drawn in
+        glm::u64 last_used = 0;
+    };
+
+    // Texture whose storage is allocated, but whose rows are still copied
+    struct Upload {
+        GLuint texture;
+        const SDL_Surface* source;
+        glm::ivec2 origin;
+        glm::ivec2 size;
+        int rows_done;
+        bool* ready;
+    };
+
+    enum class DecodeState { IDLE, DECODING, DONE, FAILED };
+
+    std::thread decoder;
+    std::atomic<DecodeState> decode_state = DecodeState::IDLE;
+    // Written by the decoder before it sets DONE
+    SDL_Surface* decoded_image = nullptr;
+    SDL_Surface* decoded_overview = nullptr;
+    std::unique_ptr<MappedFile> decoded_file;
+    std::string path;
+    // Also found by the decoder, so big sheets don't stall the main loop
+    GridDetect::Grid detected_grid;
+
+    // RGBA, 4 bytes per pixel. If the image came from the ImageCache, its
+    // pixels are in image_file.
+    SDL_Surface* image = nullptr;
+    std::unique_ptr<MappedFile> image_file;
+    int tile_size = MAX_TILE_SIZE;
+    int max_overview_size = MAX_OVERVIEW_SIZE;
+    glm::ivec2 num_tiles = {0, 0};
+    std::vector<Tile> tiles;
+    size_t num_resident = 0;
+    glm::u64 frame = 1;
+
+    // Only used if the sheet has more than one tile. The surface is kept
+    // until the texture is uploaded.
+    Texture overview;
+    SDL_Surface* overview_image = nullptr;
+    bool overview_ready = false;
+    // Size of the overview relative to the sheet, a power of two <= 1
+    float overview_scale = 1.0f;
+
+    std::deque<Upload> uploads;
+    GLuint pbo = 0;
+
+    // A single grey texel, stretched over what isn't uploaded yet
+    GLuint placeholder = 0;
+
+    void decode();
+    void finish_decoding();
+
+    // Queues the tile for upload if it isn't yet and marks it as used in
+    // this frame. Returns 0 until the upload is done.
+    GLuint use_tile(glm::ivec2 tile);
+    GLuint create_texture(glm::ivec2 size);
+    // Uploads the next rows of the first queued texture and takes their size
+    // from budget. Returns true if that finished the texture.
+    bool upload_chunk(size_t& budget);
+    void evict_unused_tile();
+    glm::ivec2 get_tile_size(glm::ivec2 tile) const;
+    void draw_placeholder(const Shader& shader, glm::vec2 position,
+                          glm::vec2 size);
+
+  public:
+    // Of the whole sheet. While decoding, the size it's expected to have.
+    glm::ivec2 dimensions = {0, 0};
+
+    TiledTexture() {}
+    // Waits for the decoder
+    ~TiledTexture();
+    TiledTexture(const TiledTexture&) = delete;
+    TiledTexture& operator=(const TiledTexture&) = delete;
+
+    // Starts decoding the image at path on a worker thread, needs a GL
+    // context. Until it's done, a placeholder of expected_dimensions is
+    // drawn. A load that is still running is waited for first.
+    void start_loading(const char* path, glm::ivec2 expected_dimensions);
+    // Deletes the tiles and the image. Waits for the decoder first, which
+    // can still be writing the image to the ImageCache after it's decoded.
+    void clear();
+
+    // Call once per frame on the GL thread, before drawing. Takes over the
+    // decoded image and uploads the next part of the queued textures.
+    // Returns true if that changed what is drawn.
+    bool update();
+
+    bool is_empty() const { return !image && !is_decoding(); }
+    // Also while the decoded image wasn't taken over by update() yet
+    bool is_decoding() const { return decode_state != DecodeState::IDLE; }
+    bool has_pending_uploads() const { return !uploads.empty(); }
+    bool is_loading() const { return is_decoding() || has_pending_uploads(); }
+    size_t get_num_resident_tiles() const { return num_resident; }
+    // The grid the sprites of the image are laid out in. Not found until the
+    // image is decoded, or if it couldn't be.
+    const GridDetect::Grid& get_detected_grid() const {
+        static const GridDetect::Grid NOT_FOUND;
+        return is_decoding() ? NOT_FOUND : detected_grid;
+    }
+
+    // Tiles that were used before this call can be evicted, called once per
+    // frame before drawing
+    void begin_frame() { ++frame; }
+
+    // Draws the part of the sheet in [visible_min, visible_max) with shader,
+    // a Shader that draws the bound texture at its own size times the texel
+    // scale (default.vert). zoom picks between the tiles and the overview.
+    // The vertex array of the quad has to be bound.
+    void draw(const Shader& shader, glm::vec2 visible_min,
+              glm::vec2 visible_max, float zoom);
+
+    // Adds the sprite at sprite_index to the batch, one instance for every
+    // tile it overlaps. Does nothing for an index of -1.
+    void add_sprite(SpriteBatch& batch, glm::vec2 position,
+                    glm::i32 sprite_index, glm::ivec2 sprite_dimensions,
+                    glm::vec4 tint = {1.0f, 1.0f, 1.0f, 1.0f});
+};
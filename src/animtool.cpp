@@ -0,0 +1,881 @@
+#pragma once
+// SDL would otherwise replace main() with its own entry point, which needs
+// SDL2main.lib and isn't useful for a command line tool
+#define SDL_MAIN_HANDLED
+
+#include "pch.h"
+#include "Animation.h"
+#include "AnimationBatch.h"
+#include "BatchLoader.h"
+#include "GridDetect.h"
+#include "ImageCache.h"
+#include "MappedFile.h"
+#include "PixelConvert.h"
+#include "Qoi.h"
+#include "TextIO.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <filesystem>
+
+/*
+    animtool: headless batch processing of animation files. No window or GL
+    context is ever created. The GL libraries are only linked for the
+    texture code of BatchLoader, which validate runs without uploads.
+
+    Usage: animtool [-j <threads>] <command> <paths...>
+
+    Commands:
+        validate            Check that every file can be read, that its
+                            sprite sheet can be decoded and that all
+                            sprite indices are inside of it
+        stat                Print statistics for every file and in total
+        convert <format>    Convert every file to anim or animb, the result
+                            is written next to the input file
+        bench-parse [steps] Measure .anim parsing speed in MB/s
+        bench-playback [instances...]
+                            Measure how many animation instances are updated
+                            per second, by default for 10k, 100k and 1M,
+                            on one thread and on all threads given by -j.
+                            Also checks that playback with render on
+                            demand keeps real time.
+        bench-convert [megapixels]
+                            Measure how fast images of every source format
+                            are converted to RGBA8, with every SIMD kernel
+                            the CPU supports
+        bench-decode <image.png>
+                            Convert the image to qoi and measure how long
+                            loading takes in both formats and from the
+                            image cache
+        bench-grid [size]   Measure sprite grid detection on a generated
+                            sheet of about size x size pixels, 16384 by
+                            default, with every SIMD kernel
+
+    Directories are searched recursively for .anim and .animb files and all
+    files are processed in parallel.
+*/
+
+namespace fs = std::filesystem;
+
+static bool has_extension(const fs::path& path, const char* extension) {
+    return path.extension() == extension;
+}
+
+static bool load_sheet(AnimationSheet& sheet, const fs::path& path) {
+    std::string path_string = path.string();
+
+    bool success;
+    if (has_extension(path, ".animb")) {
+        success = sheet.load_from_binary_file(path_string.c_str());
+    } else {
+        success = sheet.load_from_text_file(path_string.c_str());
+    }
+
+    // Everything is read at once, a file with steps that can't be read
+    // counts as unreadable
+    return success && sheet.load_all_steps();
+}
+
+static std::vector<fs::path> collect_files(char** paths, int num_paths) {
+    std::vector<fs::path> files;
+
+    for (int i = 0; i < num_paths; ++i) {
+        fs::path path(paths[i]);
+
+        if (!fs::is_directory(path)) {
+            files.push_back(path);
+            continue;
+        }
+
+        for (const auto& entry : fs::recursive_directory_iterator(path)) {
+            if (entry.is_regular_file() &&
+                (has_extension(entry.path(), ".anim") ||
+                 has_extension(entry.path(), ".animb"))) {
+                files.push_back(entry.path());
+            }
+        }
+    }
+
+    // So the output is the same on every run
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+struct FileResult {
+    std::string output;
+    size_t num_errors = 0;
+
+    size_t num_animations = 0;
+    size_t num_steps = 0;
+
+    void print(const char* format, ...) {
+        char buf[512];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(buf, sizeof(buf), format, args);
+        va_end(args);
+        output += buf;
+    }
+};
+
+static void validate_file(const BatchLoader::Entry& entry,
+                          FileResult& result) {
+    const std::string& name = entry.path;
+    const AnimationSheet& sheet = entry.sheet;
+
+    if (!entry.success) {
+        result.print("%s: can't be read\n", name.c_str());
+        ++result.num_errors;
+        return;
+    }
+
+    if (sheet.sprite_sheet.dimensions.x <= 0 ||
+        sheet.sprite_sheet.dimensions.y <= 0) {
+        result.print("%s: can't read sprite sheet %s\n", name.c_str(),
+                     sheet.png_path.c_str());
+        ++result.num_errors;
+        return;
+    }
+    // The header can be fine while the pixels are not
+    if (!entry.image_loaded) {
+        result.print("%s: can't decode sprite sheet %s\n", name.c_str(),
+                     sheet.png_path.c_str());
+        ++result.num_errors;
+        return;
+    }
+
+    if (sheet.sprite_dimensions.x <= 0 || sheet.sprite_dimensions.y <= 0) {
+        result.print("%s: invalid sprite dimensions %d,%d\n", name.c_str(),
+                     sheet.sprite_dimensions.x, sheet.sprite_dimensions.y);
+        ++result.num_errors;
+        return;
+    }
+
+    for (const auto& anim : sheet.animations) {
+        for (size_t i = 0; i < anim.steps.size(); ++i) {
+            const auto& step = anim.steps[i];
+
+            if (step.sprite_index < 0 ||
+                static_cast<size_t>(step.sprite_index) >= sheet.num_sprites) {
+                result.print("%s: '%s' step %zu: sprite index %d is not in "
+                             "[0, %zu)\n",
+                             name.c_str(), anim.name, i, step.sprite_index,
+                             sheet.num_sprites);
+                ++result.num_errors;
+            }
+            // Steps of 0 frames are skipped in playback, the editor allows
+            // them
+            if (step.duration < 0.0f || !std::isfinite(step.duration)) {
+                result.print("%s: '%s' step %zu: invalid duration %f\n",
+                             name.c_str(), anim.name, i, step.duration);
+                ++result.num_errors;
+            }
+        }
+    }
+}
+
+// The files and their sprite sheets are loaded in parallel, sheets that
+// share an image decode it once. Nothing is uploaded, there's no GL context.
+static void validate_files(const std::vector<fs::path>& files,
+                           size_t num_threads,
+                           std::vector<FileResult>& results) {
+    std::vector<std::string> paths;
+    for (const auto& path : files) {
+        paths.push_back(path.string());
+    }
+
+    BatchLoader loader(num_threads, false);
+    loader.start(paths);
+    loader.wait();
+    loader.upload_finished();
+
+    // In the order they were started
+    auto entries = loader.take_entries();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        validate_file(*entries[i], results[i]);
+    }
+}
+
+static void stat_file(const fs::path& path, FileResult& result) {
+    std::string name = path.string();
+
+    AnimationSheet sheet;
+    if (!load_sheet(sheet, path)) {
+        result.print("%s: can't be read\n", name.c_str());
+        ++result.num_errors;
+        return;
+    }
+
+    result.num_animations = sheet.animations.size();
+
+    float total_duration = 0.0f;
+    size_t max_steps = 0;
+    for (const auto& anim : sheet.animations) {
+        result.num_steps += anim.steps.size();
+        max_steps = std::max(max_steps, anim.steps.size());
+
+        for (const auto& step : anim.steps) {
+            total_duration += step.duration;
+        }
+    }
+
+    result.print("%s: sheet %dx%d, sprites %dx%d (%zu), %zu animations, "
+                 "%zu steps (max %zu per animation), %.1f frames total\n",
+                 name.c_str(), sheet.sprite_sheet.dimensions.x,
+                 sheet.sprite_sheet.dimensions.y, sheet.sprite_dimensions.x,
+                 sheet.sprite_dimensions.y, sheet.num_sprites,
+                 result.num_animations, result.num_steps, max_steps,
+                 total_duration);
+}
+
+static void convert_file(const fs::path& path, bool to_binary,
+                         FileResult& result) {
+    std::string name = path.string();
+
+    AnimationSheet sheet;
+    if (!load_sheet(sheet, path)) {
+        result.print("%s: can't be read\n", name.c_str());
+        ++result.num_errors;
+        return;
+    }
+
+    fs::path out_path = path;
+    out_path.replace_extension(to_binary ? ".animb" : ".anim");
+    std::string out_name = out_path.string();
+
+    bool saved = to_binary ? sheet.save_to_binary_file(out_name.c_str())
+                           : sheet.save_to_text_file(out_name.c_str());
+    if (!saved) {
+        result.print("%s: can't write %s: %s\n", name.c_str(),
+                     out_name.c_str(), SDL_GetError());
+        ++result.num_errors;
+        return;
+    }
+    result.print("%s -> %s\n", name.c_str(), out_name.c_str());
+}
+
+// The parser load_from_text_file used before TextReader, kept as the
+// baseline for bench-parse. Expects a null terminated buffer.
+static void legacy_parse(char* file_buf, std::vector<Animation>& animations) {
+    char* next_char = file_buf;
+
+    const size_t WORD_BUF_SIZE = AnimationSheet::MAX_SPRITE_PATH_LENGTH;
+    char word_buf[WORD_BUF_SIZE];
+
+    auto read_word = [&next_char, WORD_BUF_SIZE](char* dst_buf,
+                                                 char delim = '\n') -> size_t {
+        while (*next_char == '#') {
+            while (*next_char != '\n') {
+                if (*next_char == '\0') {
+                    return 0;
+                }
+                ++next_char;
+            }
+        }
+        if (*next_char == '\r' || *next_char == '\n') {
+            ++next_char;
+        }
+
+        size_t num_chars_written = 0;
+        while (*next_char != delim && num_chars_written != WORD_BUF_SIZE - 1) {
+            if (*next_char == '\r') {
+                ++next_char;
+                continue;
+            }
+            *dst_buf++ = *next_char++;
+            ++num_chars_written;
+        }
+        *dst_buf = '\0';
+        ++next_char;
+        return ++num_chars_written;
+    };
+
+    read_word(word_buf);
+    read_word(word_buf, ',');
+    read_word(word_buf);
+
+    read_word(word_buf);
+    size_t num_animations = atoi(word_buf);
+
+    animations.clear();
+    animations.reserve(num_animations);
+
+    for (size_t n_animation = 0; n_animation < num_animations; ++n_animation) {
+        Animation anim;
+        read_word(word_buf);
+        strncpy_s(anim.name, word_buf, Animation::MAX_NAME_LENGTH);
+
+        read_word(word_buf);
+        size_t num_steps = atoi(word_buf);
+        anim.steps.reserve(num_steps);
+
+        for (size_t n_step = 0; n_step < num_steps; ++n_step) {
+            Animation::AnimationStepData step;
+            read_word(word_buf);
+            step.sprite_index = atoi(word_buf);
+            read_word(word_buf);
+            step.duration = static_cast<float>(atof(word_buf));
+            anim.steps.push_back(step);
+        }
+        animations.push_back(anim);
+    }
+}
+
+// Runs fn a few times and returns the fastest run in seconds
+template <typename Fn> static double time_best_of(int runs, Fn fn) {
+    double best = 1e30;
+    for (int i = 0; i < runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+static int bench_parse(size_t num_steps) {
+    const size_t NUM_ANIMATIONS = 100;
+    const int NUM_RUNS = 5;
+
+    // Synthetic sheet, written by the same code as real files
+    AnimationSheetSnapshot snapshot;
+    snapshot.png_file_name = "\\bench.png";
+    snapshot.sprite_dimensions = {16, 16};
+    snapshot.animations.resize(NUM_ANIMATIONS);
+    for (size_t i = 0; i < NUM_ANIMATIONS; ++i) {
+        auto& anim = snapshot.animations[i];
+        snprintf(anim.name, Animation::MAX_NAME_LENGTH, "Animation %zu", i);
+        for (size_t n = 0; n < num_steps / NUM_ANIMATIONS; ++n) {
+            anim.steps.push_back({static_cast<glm::i32>(n % 4096),
+                                  1.0f + static_cast<float>(n % 97) / 7.0f});
+        }
+    }
+
+    TextWriter writer;
+    snapshot.write_text(writer);
+    std::vector<char> text(writer.data(), writer.data() + writer.size());
+    double megabytes = static_cast<double>(text.size()) / 1e6;
+
+    // The old parser needs a null terminator and writes nothing to the buffer
+    std::vector<char> terminated_text = text;
+    terminated_text.push_back('\0');
+    std::vector<Animation> legacy_animations;
+    double legacy_seconds = time_best_of(NUM_RUNS, [&] {
+        legacy_parse(terminated_text.data(), legacy_animations);
+    });
+
+    double seconds = 1e30;
+    bool success = true;
+    for (int i = 0; i < NUM_RUNS; ++i) {
+        // The copy is made outside of the timed part, the loader takes
+        // ownership of the buffer
+        std::vector<char> file_buf = text;
+        AnimationSheet sheet;
+        seconds = std::min(seconds, time_best_of(1, [&] {
+                               success = sheet.load_from_text(
+                                             std::move(file_buf),
+                                             "bench.anim") &&
+                                         sheet.load_all_steps() && success;
+                           }));
+    }
+    if (!success) {
+        printf("ERROR: The generated file can't be read\n");
+        return 1;
+    }
+
+    printf("%.1f MB, %zu steps\n", megabytes, num_steps);
+    printf("read_word: %8.1f MB/s\n", megabytes / legacy_seconds);
+    printf("TextReader: %7.1f MB/s (%.1fx)\n", megabytes / seconds,
+           legacy_seconds / seconds);
+    return 0;
+}
+
+// Synthetic animations with a few steps of different lengths, durations are
+// in frames like in the editor
+static std::vector<Animation> make_bench_animations(size_t num_animations) {
+    std::vector<Animation> animations(num_animations);
+    for (size_t i = 0; i < num_animations; ++i) {
+        auto& anim = animations[i];
+        size_t num_steps = 1 + i % 16;
+        for (size_t n = 0; n < num_steps; ++n) {
+            anim.steps.push_back({static_cast<glm::i32>(i * 16 + n),
+                                  1.0f + static_cast<float>((i + n) % 10)});
+        }
+        anim.update_timeline();
+    }
+    return animations;
+}
+
+// Plays a step of 60 frames like the editor does with render on demand,
+// sleeping until the step ends. That has to take one second of wall time,
+// the sleeps are no stalls that the clock may clamp.
+static int check_on_demand_playback() {
+    const double TOLERANCE = 0.05;
+
+    Animation anim;
+    anim.steps.push_back({0, 60.0f});
+    anim.steps.push_back({1, 60.0f});
+    anim.update_timeline();
+    AnimationPreview preview;
+    preview.set_animation(&anim);
+
+    PlaybackClock clock;
+    clock.start();
+    double seconds = time_best_of(1, [&] {
+        while (preview.get_sprite_index() == 0) {
+            int timeout = ticks_to_ms(preview.get_ticks_to_next_step());
+            clock.expect_wait(timeout);
+            SDL_Delay(static_cast<Uint32>(timeout));
+            preview.update(clock.tick());
+        }
+    });
+
+    printf("A 60 frame step played for %.3f s with render on demand\n",
+           seconds);
+    if (std::abs(seconds - 1.0) > TOLERANCE) {
+        printf("ERROR: The step has to take 1 s\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int bench_playback(const std::vector<size_t>& instance_counts,
+                          size_t num_threads) {
+    const size_t NUM_ANIMATIONS = 64;
+    // Enough updates per measurement to not just measure the timer
+    const size_t UPDATES_PER_RUN = 20000000;
+    const int NUM_RUNS = 3;
+    const Ticks DELTA_TIME = frames_to_ticks(0.75f);
+
+    std::vector<Animation> animations = make_bench_animations(NUM_ANIMATIONS);
+    ThreadPool pool(num_threads);
+    int result = 0;
+
+    printf("%zu threads\n", pool.num_threads());
+    printf("%10s %14s %14s %20s\n", "instances", "preview M/s", "batch M/s",
+           "parallel M/s");
+    for (size_t num_instances : instance_counts) {
+        size_t num_frames =
+            std::max<size_t>(UPDATES_PER_RUN / num_instances, 1);
+
+        std::vector<AnimationPreview> previews(num_instances);
+        AnimationBatch batch;
+        batch.set_animations(animations);
+        for (size_t i = 0; i < num_instances; ++i) {
+            Ticks start_time =
+                static_cast<Ticks>(i % 37) * TICKS_PER_FRAME;
+            previews[i].set_animation(&animations[i % NUM_ANIMATIONS]);
+            previews[i].seek(start_time);
+            batch.add_instance(i % NUM_ANIMATIONS, start_time);
+        }
+        AnimationBatch parallel_batch = batch;
+
+        double preview_seconds = time_best_of(NUM_RUNS, [&] {
+            for (size_t frame = 0; frame < num_frames; ++frame) {
+                for (auto& preview : previews) {
+                    preview.update(DELTA_TIME);
+                }
+            }
+        });
+        double batch_seconds = time_best_of(NUM_RUNS, [&] {
+            for (size_t frame = 0; frame < num_frames; ++frame) {
+                batch.update(DELTA_TIME);
+            }
+        });
+        double parallel_seconds = time_best_of(NUM_RUNS, [&] {
+            for (size_t frame = 0; frame < num_frames; ++frame) {
+                parallel_batch.update_parallel(DELTA_TIME, pool);
+            }
+        });
+
+        // Both played the same frames, so they have to show the same sprites
+        const glm::i32* sprite_indices = batch.get_sprite_indices();
+        const glm::i32* parallel_sprite_indices =
+            parallel_batch.get_sprite_indices();
+        for (size_t i = 0; i < num_instances; ++i) {
+            if (previews[i].get_sprite_index() != sprite_indices[i]) {
+                printf("ERROR: Instance %zu shows sprite %d instead of %d\n",
+                       i, sprite_indices[i], previews[i].get_sprite_index());
+                result = 1;
+                break;
+            }
+            if (parallel_sprite_indices[i] != sprite_indices[i] ||
+                parallel_batch.get_time(i) != batch.get_time(i)) {
+                printf("ERROR: Instance %zu differs in the parallel update\n",
+                       i);
+                result = 1;
+                break;
+            }
+        }
+
+        double updates = static_cast<double>(num_instances * num_frames);
+        printf("%10zu %14.1f %14.1f (%.1fx) %12.1f (%.1fx)\n", num_instances,
+               updates / preview_seconds / 1e6, updates / batch_seconds / 1e6,
+               preview_seconds / batch_seconds,
+               updates / parallel_seconds / 1e6,
+               batch_seconds / parallel_seconds);
+    }
+
+    if (check_on_demand_playback() != 0) {
+        result = 1;
+    }
+    return result;
+}
+
+static int bench_convert(size_t megapixels) {
+    const int WIDTH = 4096;
+    const int NUM_RUNS = 5;
+    using namespace PixelConvert;
+
+    int height = std::max(static_cast<int>(megapixels * 1000000 / WIDTH), 1);
+    double pixels = static_cast<double>(WIDTH) * height;
+
+    // Random colors and alphas, so premultiplying can't skip anything
+    std::vector<Uint8> src(static_cast<size_t>(WIDTH) * height * 4);
+    Uint32 seed = 12345;
+    for (auto& byte : src) {
+        seed = seed * 1664525 + 1013904223;
+        byte = static_cast<Uint8>(seed >> 24);
+    }
+    // Result of the scalar kernel, without and with premultiplying
+    std::vector<Uint8> expected[2];
+    std::vector<Uint8> dst(src.size());
+    int result = 0;
+
+    printf("%d x %d pixels\n", WIDTH, height);
+    printf("%6s %8s %16s %16s\n", "format", "kernel", "straight MP/s",
+           "premul MP/s");
+    for (int f = 0; f < static_cast<int>(Format::COUNT); ++f) {
+        Format format = static_cast<Format>(f);
+        int pitch = WIDTH * get_bytes_per_pixel(format);
+
+        for (int k = 0; k < static_cast<int>(Kernel::COUNT); ++k) {
+            Kernel kernel = static_cast<Kernel>(k);
+            if (!is_supported(kernel)) {
+                continue;
+            }
+
+            double seconds[2];
+            for (int premultiply = 0; premultiply < 2; ++premultiply) {
+                seconds[premultiply] = time_best_of(NUM_RUNS, [&] {
+                    convert(src.data(), pitch, format, dst.data(), WIDTH,
+                            height, premultiply != 0, kernel);
+                });
+
+                // The scalar kernel comes first and is the reference
+                if (kernel == Kernel::SCALAR) {
+                    expected[premultiply] = dst;
+                } else if (dst != expected[premultiply]) {
+                    printf("ERROR: %s %s differs from the scalar kernel\n",
+                           get_format_name(format), get_kernel_name(kernel));
+                    result = 1;
+                }
+            }
+
+            printf("%6s %8s %16.1f %16.1f\n", get_format_name(format),
+                   get_kernel_name(kernel), pixels / seconds[0] / 1e6,
+                   pixels / seconds[1] / 1e6);
+        }
+    }
+    return result;
+}
+
+static int bench_decode(const char* png_path) {
+    const int NUM_RUNS = 5;
+
+    SDL_Surface* img = IMG_Load(png_path);
+    if (!img) {
+        printf("ERROR: Can't load %s: %s\n", png_path, IMG_GetError());
+        return 1;
+    }
+    std::vector<Uint8> expected(static_cast<size_t>(img->w) * img->h * 4);
+    bool converted =
+        PixelConvert::convert_surface(img, expected.data(), false);
+    int width = img->w;
+    int height = img->h;
+    SDL_FreeSurface(img);
+    if (!converted) {
+        printf("ERROR: Can't convert %s: %s\n", png_path, SDL_GetError());
+        return 1;
+    }
+
+    std::vector<Uint8> qoi_buf;
+    Qoi::encode(expected.data(), width, height, 4, qoi_buf);
+    std::string qoi_path =
+        (fs::temp_directory_path() / "animtool_bench.qoi").string();
+    {
+        std::ofstream qoi_file(qoi_path, std::ios::binary);
+        qoi_file.write(reinterpret_cast<const char*>(qoi_buf.data()),
+                       qoi_buf.size());
+        if (!qoi_file) {
+            printf("ERROR: Can't write %s\n", qoi_path.c_str());
+            return 1;
+        }
+    }
+
+    // Both include reading the file, like opening a sheet does
+    double png_seconds = time_best_of(NUM_RUNS, [&] {
+        SDL_Surface* surface = IMG_Load(png_path);
+        SDL_FreeSurface(surface);
+    });
+
+    int result = 0;
+    double qoi_seconds = time_best_of(NUM_RUNS, [&] {
+        SDL_Surface* surface = Qoi::load(qoi_path.c_str());
+        if (!surface ||
+            memcmp(surface->pixels, expected.data(), expected.size()) != 0) {
+            result = 1;
+        }
+        SDL_FreeSurface(surface);
+    });
+    fs::remove(qoi_path);
+    if (result != 0) {
+        printf("ERROR: The qoi file doesn't decode to the same pixels\n");
+    }
+
+    // A hit in the ImageCache hashes the png and maps the pixels. Comparing
+    // them reads every page, like uploading them does.
+    fs::path cache_directory = fs::temp_directory_path() / "animtool_cache";
+    fs::create_directories(cache_directory);
+    ImageCache::init(cache_directory.string().c_str());
+    ImageCache::Key key;
+    if (ImageCache::get_key(png_path, key)) {
+        ImageCache::store(key, {width, height}, expected.data());
+    }
+    double cache_seconds = time_best_of(NUM_RUNS, [&] {
+        MappedFile file;
+        glm::ivec2 dimensions;
+        const Uint8* cached_pixels;
+        if (!ImageCache::get_key(png_path, key) ||
+            !ImageCache::find(key, file, dimensions, cached_pixels) ||
+            memcmp(cached_pixels, expected.data(), expected.size()) != 0) {
+            result = 2;
+        }
+    });
+    fs::remove_all(cache_directory);
+    if (result == 2) {
+        printf("ERROR: The cached image doesn't have the same pixels\n");
+    }
+
+    double pixels = static_cast<double>(width) * height;
+    printf("%d x %d pixels\n", width, height);
+    printf("%6s %12s %10s %10s\n", "format", "size (KiB)", "ms", "MP/s");
+    printf("%6s %12.1f %10.2f %10.1f\n", "png",
+           fs::file_size(png_path) / 1024.0, png_seconds * 1e3,
+           pixels / png_seconds / 1e6);
+    printf("%6s %12.1f %10.2f %10.1f (%.1fx)\n", "qoi",
+           qoi_buf.size() / 1024.0, qoi_seconds * 1e3,
+           pixels / qoi_seconds / 1e6, png_seconds / qoi_seconds);
+    printf("%6s %12.1f %10.2f %10.1f (%.1fx)\n", "cache",
+           (expected.size() + 32) / 1024.0, cache_seconds * 1e3,
+           pixels / cache_seconds / 1e6, png_seconds / cache_seconds);
+    return result != 0 ? 1 : 0;
+}
+
+static int bench_grid(int approximate_size) {
+    const int NUM_RUNS = 3;
+    // Sprites of 60 x 60, 4 pixels apart and 3 away from the top left edge
+    const int MARGIN = 3;
+    const int CELL_SIZE = 60;
+    const int PADDING = 4;
+    const int PITCH = CELL_SIZE + PADDING;
+    using namespace PixelConvert;
+
+    // The sheet is rounded up to a multiple of 256 like atlases often are,
+    // the space after the last cells stays empty
+    int num_cells = std::max((approximate_size - MARGIN) / PITCH, 2);
+    int size = (MARGIN + num_cells * PITCH - PADDING + 255) / 256 * 256;
+    size_t row_size = static_cast<size_t>(size) * 4;
+
+    // Every 7th cell stays empty like the unused end of a sheet would
+    std::vector<Uint8> pixels(row_size * size, 0);
+    for (int y = 0; y < size; ++y) {
+        int cell_y = (y - MARGIN) / PITCH;
+        if (y < MARGIN || (y - MARGIN) % PITCH >= CELL_SIZE ||
+            cell_y >= num_cells) {
+            continue;
+        }
+        for (int cell_x = 0; cell_x < num_cells; ++cell_x) {
+            if ((cell_x + cell_y * num_cells) % 7 == 6) {
+                continue;
+            }
+            Uint8* cell = pixels.data() + y * row_size +
+                          (MARGIN + cell_x * PITCH) * 4;
+            memset(cell, 0x80, CELL_SIZE * 4);
+        }
+    }
+
+    printf("%d x %d pixels\n", size, size);
+    printf("%8s %12s %12s\n", "kernel", "scan ms", "GB/s");
+    std::vector<Uint8> columns(size), rows(size);
+    std::vector<Uint8> expected_columns, expected_rows;
+    int result = 0;
+    for (int k = 0; k < static_cast<int>(Kernel::COUNT); ++k) {
+        Kernel kernel = static_cast<Kernel>(k);
+        if (!is_supported(kernel)) {
+            continue;
+        }
+        double seconds = time_best_of(NUM_RUNS, [&] {
+            scan_alpha(pixels.data(), static_cast<int>(row_size), size, size,
+                       columns.data(), rows.data(), kernel);
+        });
+
+        if (kernel == Kernel::SCALAR) {
+            expected_columns = columns;
+            expected_rows = rows;
+        } else if (columns != expected_columns || rows != expected_rows) {
+            printf("ERROR: %s differs from the scalar kernel\n",
+                   get_kernel_name(kernel));
+            result = 1;
+        }
+        printf("%8s %12.2f %12.2f\n", get_kernel_name(kernel), seconds * 1e3,
+               pixels.size() / seconds / 1e9);
+    }
+
+    GridDetect::Grid grid;
+    double seconds = time_best_of(NUM_RUNS, [&] {
+        grid = GridDetect::detect(pixels.data(), static_cast<int>(row_size),
+                                  {size, size});
+    });
+    printf("Detection: %.2f ms in total\n", seconds * 1e3);
+    printf("Cell size %d x %d, offset %d, %d, padding %d, %d\n",
+           grid.cell_size.x, grid.cell_size.y, grid.offset.x, grid.offset.y,
+           grid.padding.x, grid.padding.y);
+
+    if (!grid.found || grid.cell_size != glm::ivec2(CELL_SIZE) ||
+        grid.offset != glm::ivec2(MARGIN) ||
+        grid.padding != glm::ivec2(PADDING)) {
+        printf("ERROR: Expected cell size %d, offset %d, padding %d\n",
+               CELL_SIZE, MARGIN, PADDING);
+        result = 1;
+    }
+    return result;
+}
+
+static int print_usage() {
+    printf("Usage: animtool [-j <threads>] <command> <paths...>\n"
+           "Commands:\n"
+           "  validate             check files, sheets and sprite indices\n"
+           "  stat                 print statistics\n"
+           "  convert <anim|animb> convert files to the given format\n"
+           "  bench-parse [steps]  measure .anim parsing speed\n"
+           "  bench-playback [instances...]\n"
+           "                       measure animation updates per second\n"
+           "  bench-convert [megapixels]\n"
+           "                       measure pixel format conversion speed\n"
+           "  bench-decode <image.png>\n"
+           "                       compare png, qoi and cached loads\n"
+           "  bench-grid [size]    measure sprite grid detection speed\n");
+    return 2;
+}
+
+int main(int argc, char* argv[]) {
+    int arg = 1;
+    size_t num_threads = 0;
+
+    if (arg + 1 < argc && strcmp(argv[arg], "-j") == 0) {
+        num_threads = static_cast<size_t>(atoi(argv[arg + 1]));
+        arg += 2;
+    }
+    if (arg >= argc) {
+        return print_usage();
+    }
+
+    const char* command = argv[arg++];
+
+    if (strcmp(command, "bench-parse") == 0) {
+        size_t num_steps = arg < argc ? atoi(argv[arg]) : 1000000;
+        return bench_parse(num_steps);
+    }
+    if (strcmp(command, "bench-playback") == 0) {
+        std::vector<size_t> instance_counts;
+        for (; arg < argc; ++arg) {
+            size_t num_instances = static_cast<size_t>(atoll(argv[arg]));
+            if (num_instances == 0) {
+                return print_usage();
+            }
+            instance_counts.push_back(num_instances);
+        }
+        if (instance_counts.empty()) {
+            instance_counts = {10000, 100000, 1000000};
+        }
+        return bench_playback(instance_counts, num_threads);
+    }
+
+    if (strcmp(command, "bench-convert") == 0) {
+        size_t megapixels = arg < argc ? atoi(argv[arg]) : 16;
+        if (megapixels == 0) {
+            return print_usage();
+        }
+        return bench_convert(megapixels);
+    }
+    if (strcmp(command, "bench-decode") == 0) {
+        if (arg >= argc) {
+            return print_usage();
+        }
+        return bench_decode(argv[arg]);
+    }
+    if (strcmp(command, "bench-grid") == 0) {
+        int size = arg < argc ? atoi(argv[arg]) : 16384;
+        if (size <= 0) {
+            return print_usage();
+        }
+        return bench_grid(size);
+    }
+
+    bool to_binary = false;
+    if (strcmp(command, "convert") == 0) {
+        if (arg >= argc) {
+            return print_usage();
+        }
+        const char* format = argv[arg++];
+        if (strcmp(format, "animb") == 0) {
+            to_binary = true;
+        } else if (strcmp(format, "anim") != 0) {
+            return print_usage();
+        }
+    } else if (strcmp(command, "validate") != 0 &&
+               strcmp(command, "stat") != 0) {
+        return print_usage();
+    }
+
+    std::vector<fs::path> files = collect_files(argv + arg, argc - arg);
+    std::vector<FileResult> results(files.size());
+
+    if (strcmp(command, "validate") == 0) {
+        validate_files(files, num_threads, results);
+    } else {
+        ThreadPool pool(num_threads);
+        for (size_t i = 0; i < files.size(); ++i) {
+            pool.submit([&, i] {
+                if (strcmp(command, "stat") == 0) {
+                    stat_file(files[i], results[i]);
+                } else {
+                    convert_file(files[i], to_binary, results[i]);
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    size_t num_errors = 0;
+    size_t num_animations = 0;
+    size_t num_steps = 0;
+    for (const auto& result : results) {
+        fputs(result.output.c_str(), stdout);
+        num_errors += result.num_errors;
+        num_animations += result.num_animations;
+        num_steps += result.num_steps;
+    }
+
+    if (strcmp(command, "stat") == 0) {
+        printf("%zu files, %zu animations, %zu steps\n", files.size(),
+               num_animations, num_steps);
+    }
+    printf("%zu errors\n", num_errors);
+
+    return num_errors == 0 ? 0 : 1;
+}
@@ -1,9 +1,19 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include <shobjidl.h>
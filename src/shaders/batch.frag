@@ -0,0 +1,12 @@
+#version 330 core
+in vec2 uv_coord;
+in vec4 tint;
+
+out vec4 frag_color;
+
+uniform sampler2D texture1;
+
+void main()
+{
+    frag_color=texture(texture1,uv_coord)*tint;
+}
\ No newline at end of file
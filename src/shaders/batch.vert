@@ -0,0 +1,28 @@
+#version 330 core
+layout(location=1)in vec2 instance_position;
+layout(location=2)in vec2 instance_source;
+layout(location=3)in vec2 instance_size;
+layout(location=4)in vec4 instance_tint;
+
+out vec2 uv_coord;
+out vec4 tint;
+
+uniform sampler2D texture1;
+layout(std140)uniform Camera{
+    mat4 projection;
+    vec2 view_position;
+    float zoom;
+};
+
+void main()
+{
+    // The corners of the quad come from gl_VertexID, in triangle strip order
+    vec2 pos=vec2(float(gl_VertexID&1),float(gl_VertexID>>1));
+
+    vec2 texture_dimensions=vec2(textureSize(texture1,0));
+    uv_coord=(instance_source+pos*instance_size)/texture_dimensions;
+    tint=instance_tint;
+
+    vec2 world_position=instance_position+pos*instance_size;
+    gl_Position=projection*vec4((world_position-view_position)*zoom,0.,1.);
+}
\ No newline at end of file
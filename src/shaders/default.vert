@@ -6,11 +6,17 @@ out vec2 uv_coord;
 
 uniform sampler2D texture1;
 uniform vec2 render_position;
-uniform mat4 projection;
+uniform vec2 texel_scale;
+layout(std140)uniform Camera{
+    mat4 projection;
+    vec2 view_position;
+    float zoom;
+};
 
 void main()
 {
     uv_coord=in_uv_coord;
     ivec2 sheet_dimensions=textureSize(texture1,0);
-    gl_Position=projection*vec4(render_position.x+pos.x*float(sheet_dimensions.x),render_position.y+pos.y*float(sheet_dimensions.y),0.,1.);
+    vec2 world_position=render_position+pos*vec2(sheet_dimensions)*texel_scale;
+    gl_Position=projection*vec4((world_position-view_position)*zoom,0.,1.);
 }
\ No newline at end of file
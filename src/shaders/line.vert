@@ -1,11 +1,29 @@
 #version 330 core
-layout(location=0)in vec2 pos;
 
+// Draws the lines around a range of sprites in one call without a vertex
+// buffer. Every line has two vertices, the vertical lines come first.
+uniform ivec2 first_cell;
+uniform ivec2 grid_size;
 uniform vec2 render_position;
 uniform vec2 sprite_dimensions;
-uniform mat4 projection;
+layout(std140)uniform Camera{
+    mat4 projection;
+    vec2 view_position;
+    float zoom;
+};
 
 void main()
 {
-    gl_Position=projection*vec4(pos.x*sprite_dimensions.x+render_position.x,pos.y*sprite_dimensions.y+render_position.y,0.,1.);
+    int line=gl_VertexID/2;
+    float line_end=float(gl_VertexID%2);
+
+    vec2 pos;
+    if(line<=grid_size.x){
+        pos=vec2(float(line),line_end*float(grid_size.y));
+    }else{
+        pos=vec2(line_end*float(grid_size.x),float(line-grid_size.x-1));
+    }
+
+    vec2 world_position=(pos+vec2(first_cell))*sprite_dimensions+render_position;
+    gl_Position=projection*vec4((world_position-view_position)*zoom,0.,1.);
 }
\ No newline at end of file